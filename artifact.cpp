@@ -0,0 +1,184 @@
+#include "artifact.h"
+#include "mappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[4] = { 'T', 'L', 'C', '\x1a' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nodeSize;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t nodeCount;
+    uint32_t listCount;
+    uint32_t stringOffsetCount;
+    uint32_t stringBytes;
+    uint32_t diagnosticsBytes;
+    uint32_t root;
+    // Of everything after the header.
+    uint64_t checksum;
+};
+
+static_assert(sizeof(Header) == 64, "artifact header layout must not depend on padding");
+
+template <typename T>
+void appendArray(std::string& out, const T* items, size_t count)
+{
+    out.append(reinterpret_cast<const char*>(items), count * sizeof(T));
+}
+
+template <typename T>
+void readArray(std::string_view& in, std::vector<T>& items, size_t count)
+{
+    items.resize(count);
+    if (count > 0) {
+        std::memcpy(items.data(), in.data(), count * sizeof(T));
+    }
+    in.remove_prefix(count * sizeof(T));
+}
+
+} // namespace
+
+uint64_t ProgramArtifact::hash(std::string_view bytes)
+{
+    // FNV-1a taken a 64-bit word at a time rather than a byte at a time: the
+    // multiply chain is what limits it, so this is several times faster.
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ bytes.size();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; i < bytes.size(); i++) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * prime;
+    }
+    return hash;
+}
+
+bool ProgramArtifact::isArtifact(std::string_view bytes)
+{
+    return bytes.size() >= sizeof(MAGIC) && std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string ProgramArtifact::serialize(const FlatProgram& program, std::string_view source, std::string_view diagnostics)
+{
+    Header header {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.nodeSize = sizeof(FlatProgram::Node);
+    header.sourceHash = hash(source);
+    header.sourceSize = source.size();
+    header.nodeCount = static_cast<uint32_t>(program.nodes.size());
+    header.listCount = static_cast<uint32_t>(program.lists.size());
+    header.stringOffsetCount = static_cast<uint32_t>(program.stringOffsets.size());
+    header.stringBytes = static_cast<uint32_t>(program.stringData.size());
+    header.diagnosticsBytes = static_cast<uint32_t>(diagnostics.size());
+    header.root = program.root;
+
+    std::string out(sizeof(Header), '\0');
+    appendArray(out, program.nodes.data(), program.nodes.size());
+    appendArray(out, program.lists.data(), program.lists.size());
+    appendArray(out, program.stringOffsets.data(), program.stringOffsets.size());
+    out += program.stringData;
+    out += diagnostics;
+
+    header.checksum = hash(std::string_view(out).substr(sizeof(Header)));
+    std::memcpy(&out[0], &header, sizeof(Header));
+    return out;
+}
+
+ProgramArtifact::Loaded ProgramArtifact::load(std::string_view bytes)
+{
+    Header header;
+    if (!isArtifact(bytes) || bytes.size() < sizeof(Header)) {
+        throw std::runtime_error("not a compiled program");
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (header.version != VERSION) {
+        throw std::runtime_error("compiled by an incompatible version (format " + std::to_string(header.version) + ", expected " + std::to_string(VERSION) + ")");
+    }
+    if (header.byteOrder != BYTE_ORDER_MARK || header.nodeSize != sizeof(FlatProgram::Node)) {
+        throw std::runtime_error("compiled on an incompatible platform");
+    }
+
+    std::string_view payload = bytes.substr(sizeof(Header));
+    uint64_t expectedSize = uint64_t(header.nodeCount) * sizeof(FlatProgram::Node) + uint64_t(header.listCount) * sizeof(uint32_t)
+        + uint64_t(header.stringOffsetCount) * sizeof(uint32_t) + header.stringBytes + header.diagnosticsBytes;
+    if (payload.size() != expectedSize || hash(payload) != header.checksum) {
+        throw std::runtime_error("corrupt (checksum mismatch)");
+    }
+
+    Loaded loaded;
+    FlatProgram& program = loaded.program;
+    readArray(payload, program.nodes, header.nodeCount);
+    readArray(payload, program.lists, header.listCount);
+    readArray(payload, program.stringOffsets, header.stringOffsetCount);
+    program.stringData.assign(payload.substr(0, header.stringBytes));
+    loaded.diagnostics.assign(payload.substr(header.stringBytes, header.diagnosticsBytes));
+    program.root = header.root;
+    loaded.sourceHash = header.sourceHash;
+    loaded.sourceSize = header.sourceSize;
+
+    if (!program.isWellFormed()) {
+        throw std::runtime_error("corrupt (malformed program)");
+    }
+    return loaded;
+}
+
+ProgramCache::ProgramCache(std::string directory)
+    : directory(std::move(directory))
+{
+}
+
+std::string ProgramCache::pathFor(std::string_view source) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.tlc", static_cast<unsigned long long>(ProgramArtifact::hash(source)));
+    return directory + "/" + name;
+}
+
+bool ProgramCache::load(std::string_view source, ProgramArtifact::Loaded& loaded) const
+{
+    MappedFile file;
+    if (!file.open(pathFor(source))) {
+        return false;
+    }
+    try {
+        loaded = ProgramArtifact::load(file.view());
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    // The file name is only the hash; make sure it is this source's.
+    return loaded.sourceHash == ProgramArtifact::hash(source) && loaded.sourceSize == source.size();
+}
+
+bool ProgramCache::store(std::string_view source, const FlatProgram& program, std::string_view diagnostics) const
+{
+    mkdir(directory.c_str(), 0777);
+
+    std::string path = pathFor(source);
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    std::string bytes = ProgramArtifact::serialize(program, source, diagnostics);
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+    out.close();
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
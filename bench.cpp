@@ -0,0 +1,870 @@
+// Throughput benchmarks for the front end and the execution engines.
+//
+//   tiny-bench <benchmark> [options]
+//
+// Every benchmark generates its own synthetic TINY program so the numbers are
+// reproducible without any input files.
+
+#include "artifact.h"
+#include "flatAst.h"
+#include "inputBuffer.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "outputSink.h"
+#include "parser.h"
+#include "scan.h"
+#include "token.h"
+#include "tokenBuffer.h"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Best-of-`runs` wall time of `body`, in seconds.
+double timeBest(int runs, const function<void()>& body)
+{
+    double best = 1e100;
+    for (int i = 0; i < runs; i++) {
+        auto start = chrono::steady_clock::now();
+        body();
+        best = min(best, secondsSince(start));
+    }
+    return best;
+}
+
+void report(const string& label, double seconds, double bytes)
+{
+    cout << "  " << left << setw(24) << label << right << fixed << setprecision(3)
+         << setw(9) << seconds * 1000 << " ms" << setw(10) << setprecision(1)
+         << bytes / seconds / (1 << 20) << " MB/s" << endl;
+}
+
+size_t countTokens(const string& source)
+{
+    Lexer lexer(source);
+    size_t count = 0;
+    while (lexer.nextToken().type != Token::Type::ENDOFFILE) {
+        count++;
+    }
+    return count;
+}
+
+// Mostly comments, long string literals and indentation: the shape of the
+// generated programs that motivated the vectorized scanners.
+string commentHeavySource(size_t targetBytes)
+{
+    string source;
+    int n = 0;
+    while (source.size() < targetBytes) {
+        source += "{ ";
+        source += string(200 + n % 300, 'c');
+        source += "\n  generated block " + to_string(n) + "\n }\n";
+        source += "        write \"" + string(100 + n % 120, 's') + "\";\n";
+        source += "        x" + to_string(n % 17) + " := x" + to_string(n % 13) + " + " + to_string(n) + ";\n";
+        n++;
+    }
+    return source;
+}
+
+int benchScan(const vector<string>& args)
+{
+    size_t megabytes = args.empty() ? 64 : stoul(args[0]);
+    string source = commentHeavySource(megabytes << 20);
+    cout << "scan: " << source.size() / (1 << 20) << " MB of comment/literal-heavy source" << endl;
+
+    for (scan::Isa isa : { scan::Isa::Scalar, scan::Isa::SSE2, scan::Isa::AVX2 }) {
+        scan::Isa active = scan::useIsa(isa);
+        if (active != isa) {
+            cout << "  " << scan::isaName(isa) << ": not supported on this CPU" << endl;
+            continue;
+        }
+        size_t tokens = 0;
+        double seconds = timeBest(3, [&] { tokens = countTokens(source); });
+        report(string("lex/") + scan::isaName(isa), seconds, source.size());
+    }
+    return 0;
+}
+
+// Statement-dense code with short identifiers: token overhead dominates.
+string statementHeavySource(size_t targetBytes)
+{
+    string source;
+    int n = 0;
+    while (source.size() < targetBytes) {
+        string v = "v" + to_string(n % 97);
+        source += v + " := (" + v + " + " + to_string(n % 1000) + ") * w" + to_string(n % 31) + " - 1;\n";
+        source += "if " + v + " < 10 then write " + v + ", \"x\"; end\n";
+        n++;
+    }
+    return source;
+}
+
+int benchTokenize(const vector<string>& args)
+{
+    size_t megabytes = args.empty() ? 32 : stoul(args[0]);
+    string source = statementHeavySource(megabytes << 20);
+    cout << "tokenize: " << source.size() / (1 << 20) << " MB of statement-heavy source" << endl;
+
+    size_t tokens = 0;
+    double seconds = timeBest(3, [&] {
+        Lexer lexer(source);
+        vector<Token> all;
+        while (true) {
+            all.push_back(lexer.nextToken());
+            if (all.back().type == Token::Type::ENDOFFILE) {
+                break;
+            }
+        }
+        tokens = all.size();
+    });
+    report("nextToken -> vector<Token>", seconds, source.size());
+    cout << "  " << tokens << " tokens, " << tokens * sizeof(Token) / (1 << 20) << " MB as Token" << endl;
+
+    seconds = timeBest(3, [&] {
+        Lexer lexer(source);
+        TokenBuffer buffer = lexer.tokenizeAll();
+        tokens = buffer.size();
+    });
+    report("tokenizeAll", seconds, source.size());
+    size_t soaBytes = tokens * (sizeof(Token::Type) + 2 * sizeof(uint32_t));
+    cout << "  " << tokens << " tokens, " << soaBytes / (1 << 20) << " MB as TokenBuffer" << endl;
+    return 0;
+}
+
+int benchLexParallel(const vector<string>& args)
+{
+    size_t megabytes = args.size() > 0 ? stoul(args[0]) : 64;
+    unsigned maxThreads = args.size() > 1 ? stoul(args[1]) : max(1u, thread::hardware_concurrency());
+    string source = statementHeavySource(megabytes << 20);
+    cout << "lex-parallel: " << source.size() / (1 << 20) << " MB, 1.." << maxThreads << " threads" << endl;
+
+    TokenBuffer reference = Lexer(source).tokenizeAll();
+    double baseline = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        TokenBuffer tokens;
+        double seconds = timeBest(3, [&] { tokens = Lexer::tokenizeParallel(source, threads); });
+        bool same = tokens.size() == reference.size();
+        for (size_t i = 0; same && i < tokens.size(); i++) {
+            same = tokens.type(i) == reference.type(i) && tokens.offset(i) == reference.offset(i) && tokens.length(i) == reference.length(i);
+        }
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        report(to_string(threads) + " thread(s)", seconds, source.size());
+        cout << "    speedup " << setprecision(2) << baseline / seconds << "x" << (same ? "" : "  MISMATCH") << endl;
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    return 0;
+}
+
+// Long arithmetic expressions mixing every precedence level.
+string expressionHeavySource(size_t targetBytes)
+{
+    static const char* ops[] = { " + ", " - ", " * ", " / ", " < ", " = ", " >= " };
+    string source;
+    int n = 0;
+    while (source.size() < targetBytes) {
+        source += "r" + to_string(n % 50) + " := ";
+        for (int i = 0; i < 12; i++) {
+            if (i % 5 == 2) {
+                source += "(a" + to_string(i) + " + " + to_string(n % 91) + ")";
+            } else {
+                source += i % 2 ? "b" + to_string(n % 7) : to_string(i + n % 13);
+            }
+            source += i < 11 ? ops[(n + i) % 7] : ";\n";
+        }
+        n++;
+    }
+    return source;
+}
+
+int benchParse(const vector<string>& args)
+{
+    size_t megabytes = args.empty() ? 16 : stoul(args[0]);
+    string source = expressionHeavySource(megabytes << 20);
+    cout << "parse: " << source.size() / (1 << 20) << " MB of expression-heavy source" << endl;
+
+    size_t statements = 0;
+    double seconds = timeBest(3, [&] {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        statements = parser.parse().size();
+    });
+    report("lex + parse", seconds, source.size());
+    cout << "  " << statements << " statements" << endl;
+    return 0;
+}
+
+int benchParseParallel(const vector<string>& args)
+{
+    size_t megabytes = args.size() > 0 ? stoul(args[0]) : 64;
+    unsigned maxThreads = args.size() > 1 ? stoul(args[1]) : max(1u, thread::hardware_concurrency());
+    string source = statementHeavySource(megabytes << 20);
+    cout << "parse-parallel: " << source.size() / (1 << 20) << " MB, 1.." << maxThreads << " threads" << endl;
+
+    string reference;
+    {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        for (Statement* stmt : parser.parse()) {
+            reference += stmt->toString();
+        }
+    }
+    double baseline = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        ParseResult parsed;
+        double seconds = timeBest(3, [&] { parsed = Parser::parseParallel(source, threads); });
+        string output;
+        for (Statement* stmt : parsed.statements) {
+            output += stmt->toString();
+        }
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        report(to_string(threads) + " thread(s)", seconds, source.size());
+        cout << "    speedup " << setprecision(2) << baseline / seconds << "x" << (output == reference ? "" : "  MISMATCH") << endl;
+        if (threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    return 0;
+}
+
+int benchArtifact(const vector<string>& args)
+{
+    size_t kilobytes = args.empty() ? 64 : stoul(args[0]);
+    string source = statementHeavySource(kilobytes << 10);
+    cout << "artifact: " << source.size() / 1024 << " KiB of statement-heavy source" << endl;
+
+    size_t statements = 0;
+    double parseSeconds = timeBest(5, [&] {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        statements = parser.parseProgram().statements.size();
+    });
+    report("lex + parse", parseSeconds, source.size());
+
+    Lexer lexer(source);
+    Parser parser(lexer);
+    string bytes = ProgramArtifact::serialize(FlatProgram::flatten(parser.parseProgram().statements), source, "");
+    double loadSeconds = timeBest(5, [&] {
+        ProgramArtifact::Loaded loaded = ProgramArtifact::load(bytes);
+        statements = loaded.program.getLists()[loaded.program.getRoot()];
+    });
+    report("load .tlc", loadSeconds, source.size());
+    double rebuildSeconds = timeBest(5, [&] {
+        ProgramArtifact::Loaded loaded = ProgramArtifact::load(bytes);
+        Arena arena;
+        statements = loaded.program.toStatements(arena).size();
+    });
+    report("load .tlc + rebuild tree", rebuildSeconds, source.size());
+    cout << "  " << statements << " statements, artifact " << bytes.size() / 1024 << " KiB" << endl;
+    return 0;
+}
+
+// A tight repeat loop doing arithmetic on a handful of variables.
+string loopSource(long iterations)
+{
+    return "i := 0; s := 0; total := 1;\n"
+           "repeat\n"
+           "  s := s + i * 2 - total / 3;\n"
+           "  total := total + 1;\n"
+           "  i := i + 1;\n"
+           "until i >= "
+        + to_string(iterations) + ";\nwrite s;\n";
+}
+
+// 10! computed over and over; one iteration is one multiply step.
+string factorialSource(long iterations)
+{
+    return "count := 0;\n"
+           "repeat\n"
+           "  f := 1; n := 10;\n"
+           "  repeat\n"
+           "    f := f * n;\n"
+           "    n := n - 1;\n"
+           "  until n = 0;\n"
+           "  count := count + 1;\n"
+           "until count >= "
+        + to_string(iterations / 10) + ";\nwrite f;\n";
+}
+
+// 1 + 2 + ... + N.
+string sumSource(long iterations)
+{
+    return "n := " + to_string(iterations) + "; s := 0; i := 1;\n"
+           "repeat\n"
+           "  s := s + i;\n"
+           "  i := i + 1;\n"
+           "until i > n;\nwrite s;\n";
+}
+
+// A loop whose body mostly computes values nobody reads.
+string deadStoreSource(long iterations)
+{
+    return "i := 0; s := 0;\n"
+           "repeat\n"
+           "  t := i * 3 + s;\n"
+           "  u := t / 2;\n"
+           "  t := i + 1;\n"
+           "  s := s + t;\n"
+           "  i := i + 1;\n"
+           "until i >= "
+        + to_string(iterations) + ";\nwrite s;\n";
+}
+
+int benchInterpret(const vector<string>& args)
+{
+    long iterations = args.empty() ? 1000000 : stol(args[0]);
+    const pair<const char*, string> workloads[] = {
+        { "repeat loop", loopSource(iterations) },
+        { "factorial", factorialSource(iterations) },
+        { "sum to N", sumSource(iterations) },
+        { "dead stores", deadStoreSource(iterations) },
+    };
+    struct EngineRow {
+        const char* name;
+        Interpreter::Engine engine;
+        bool integers;
+    };
+    const EngineRow engines[] = {
+        { "tree", Interpreter::Engine::TreeWalk, false },
+        { "flat", Interpreter::Engine::Flat, false },
+        { "closure", Interpreter::Engine::Closure, false },
+        { "vm", Interpreter::Engine::Vm, false },
+        { "vm --int64", Interpreter::Engine::Vm, true },
+        { "jit", Interpreter::Engine::Jit, false },
+    };
+    for (const auto& workload : workloads) {
+        Lexer lexer(workload.second);
+        Parser parser(lexer);
+        ParseResult parsed = parser.parseProgram();
+        cout << "interpret: " << workload.first << ", " << iterations << " iterations" << endl;
+
+        for (int level = 0; level <= 2; level++) {
+            vector<Statement*> program = Optimizer(*parsed.arena, level).optimize(parsed.statements);
+            for (const auto& engine : engines) {
+                string output;
+                double seconds = timeBest(3, [&] {
+                    istringstream input;
+                    ostringstream out;
+                    Interpreter interpreter(input, out);
+                    interpreter.setEngine(engine.engine);
+                    interpreter.setIntegerArithmetic(engine.integers);
+                    interpreter.interpret(program);
+                    output = out.str();
+                });
+                string label = string(engine.name) + " -O" + to_string(level);
+                cout << "  " << left << setw(24) << label << right << fixed << setprecision(3)
+                     << setw(9) << seconds * 1000 << " ms" << setw(10) << setprecision(1)
+                     << seconds * 1e9 / iterations << " ns/iteration   -> " << output;
+            }
+        }
+    }
+    return 0;
+}
+
+// A random program built around `repeat` loops the JIT compiles: only
+// assignments and nested loops, with every operator, divisions that can hit
+// zero, values that overflow to inf and NaN, and variables that may be
+// undefined when the loop starts.
+class LoopProgramGenerator {
+public:
+    // With `nearExactLimit`, numbers around 2^24, where float stops
+    // holding every integer, are generated too.
+    explicit LoopProgramGenerator(unsigned seed, bool nearExactLimit = false)
+        : random(seed)
+        , nearExactLimit(nearExactLimit)
+    {
+    }
+
+    string program()
+    {
+        string text;
+        for (const char* name : VARIABLES) {
+            if (chance(0.9)) {
+                text += string(name) + " := " + to_string(pick(10)) + ";\n";
+            }
+        }
+        text += loop(0);
+        for (const char* name : VARIABLES) {
+            text += "write \"" + string(name) + "=\", " + name + ";\n";
+        }
+        if (nearExactLimit) {
+            // Folded at -O1, and computed in float if the loops overflowed.
+            text += string("write \"k=\", ") + LARGE[pick(4)] + " " + OPERATORS[pick(9)] + " " + LARGE[pick(4)] + ";\n";
+        }
+        return text;
+    }
+
+private:
+    static constexpr const char* VARIABLES[] = { "a", "b", "c", "x", "y", "z" };
+    static constexpr const char* OPERATORS[] = { "+", "-", "*", "/", "<", "<=", ">", ">=", "=" };
+    static constexpr const char* LARGE[] = { "16777215", "16777216", "16777217", "33554431" };
+    mt19937 random;
+    bool nearExactLimit;
+    int loops = 0;
+
+    int pick(int count) { return uniform_int_distribution<int>(0, count - 1)(random); }
+    bool chance(double p) { return uniform_real_distribution<double>(0, 1)(random) < p; }
+
+    // An expression over the variables and `counter`, the innermost loop's
+    // counter.
+    string expr(int depth, const string& counter)
+    {
+        if (depth > 3 || chance(0.3)) {
+            if (chance(0.4)) {
+                const char* numbers[] = { "0", "1", "2", "3", "10", "7", "1000000" };
+                return nearExactLimit && chance(0.3) ? LARGE[pick(4)] : numbers[pick(7)];
+            }
+            if (chance(0.2)) {
+                return counter;
+            }
+            return VARIABLES[pick(6)];
+        }
+        if (chance(0.15)) {
+            return "(" + expr(depth + 1, counter) + ")";
+        }
+        return expr(depth + 1, counter) + " " + OPERATORS[pick(9)] + " " + expr(depth + 1, counter);
+    }
+
+    // A loop that runs 1 to 6 times, whatever its body does.
+    string loop(int depth)
+    {
+        string counter = "k" + to_string(loops++);
+        int times = 1 + pick(6);
+        string body;
+        for (int i = 0, n = 1 + pick(4); i < n; i++) {
+            if (depth < 2 && chance(0.2)) {
+                body += loop(depth + 1);
+            } else if (nearExactLimit && chance(0.1)) {
+                // Overflows int64_t within a few iterations.
+                const char* name = VARIABLES[pick(6)];
+                body += string(name) + " := " + name + " * 3037000499;\n";
+            } else {
+                body += string(VARIABLES[pick(6)]) + " := " + expr(0, counter) + ";\n";
+            }
+        }
+        const string conditions[] = {
+            counter + " >= " + to_string(times),
+            counter + " = " + to_string(times),
+            to_string(times) + " <= " + counter,
+            to_string(times) + " < " + counter + " + 1",
+            counter + " > " + to_string(times - 1),
+            "(" + counter + " >= " + to_string(times) + ") * 2",
+            counter + " - " + counter + " + 1",
+        };
+        return counter + " := 0;\nrepeat\n" + body + counter + " := " + counter + " + 1;\nuntil " + conditions[pick(7)] + ";\n";
+    }
+};
+
+// Arithmetic on variables and constants, most of it var-op-const.
+string arithmeticSource(long iterations)
+{
+    return "i := 0; s := 0;\n"
+           "repeat\n"
+           "  x := i * 3 + 7;\n"
+           "  y := x - 2 * i;\n"
+           "  s := s + y / 4 - x * 2;\n"
+           "  i := i + 1;\n"
+           "until i >= "
+        + to_string(iterations) + ";\nwrite s;\n";
+}
+
+// A copy of a program with every BinaryExpr made as the generic node rather
+// than by makeBinaryExpr(), to time what the specialization saves.
+class GenericCopy {
+public:
+    explicit GenericCopy(Arena& arena)
+        : arena(arena)
+    {
+    }
+
+    vector<Statement*> statements(const vector<Statement*>& stmts)
+    {
+        vector<Statement*> result;
+        for (Statement* stmt : stmts) {
+            result.push_back(statement(stmt));
+        }
+        return result;
+    }
+
+private:
+    Arena& arena;
+
+    ArenaList<Statement*> list(const ArenaList<Statement*>& stmts)
+    {
+        return ArenaList<Statement*>(arena, statements(vector<Statement*>(stmts.begin(), stmts.end())));
+    }
+
+    Statement* statement(Statement* stmt)
+    {
+        if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+            return arena.make<AssignmentStatement>(assignment->getIdentifier(), expr(assignment->getExpression()));
+        }
+        if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+            return arena.make<IfStatement>(expr(ifStmt->getCondition()), list(ifStmt->getThenBranch()), list(ifStmt->getElseBranch()));
+        }
+        if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+            return arena.make<RepeatStatement>(list(repeat->getBody()), expr(repeat->getCondition()));
+        }
+        if (auto write = dynamic_cast<WriteStatement*>(stmt)) {
+            vector<Expr*> operands;
+            for (Expr* operand : write->getOperands()) {
+                operands.push_back(expr(operand));
+            }
+            return arena.make<WriteStatement>(ArenaList<Expr*>(arena, operands));
+        }
+        return stmt;
+    }
+
+    Expr* expr(Expr* e)
+    {
+        if (auto binary = dynamic_cast<BinaryExpr*>(e)) {
+            return arena.make<BinaryExpr>(expr(binary->getLeft()), binary->getOperator(), expr(binary->getRight()));
+        }
+        if (auto grouping = dynamic_cast<GroupingExpression*>(e)) {
+            return arena.make<GroupingExpression>(expr(grouping->getExpression()));
+        }
+        return e;
+    }
+};
+
+// The tree walker on BinaryOp nodes against generic BinaryExpr nodes.
+int benchBinaryOps(const vector<string>& args)
+{
+    long iterations = args.empty() ? 1000000 : stol(args[0]);
+    const pair<const char*, string> workloads[] = {
+        { "repeat loop", loopSource(iterations) },
+        { "arithmetic", arithmeticSource(iterations) },
+        { "sum to N", sumSource(iterations) },
+    };
+    for (const auto& workload : workloads) {
+        Lexer lexer(workload.second);
+        ParseResult parsed = Parser(lexer).parseProgram();
+        cout << "binary-ops: " << workload.first << ", " << iterations << " iterations" << endl;
+        for (int level = 0; level <= 1; level++) {
+            vector<Statement*> specialized = Optimizer(*parsed.arena, level).optimize(parsed.statements);
+            vector<Statement*> generic = GenericCopy(*parsed.arena).statements(specialized);
+            const pair<const char*, const vector<Statement*>*> variants[] = {
+                { "generic", &generic },
+                { "specialized", &specialized },
+            };
+            for (const auto& variant : variants) {
+                string output;
+                double seconds = timeBest(3, [&] {
+                    istringstream input;
+                    ostringstream out;
+                    Interpreter interpreter(input, out);
+                    interpreter.interpret(*variant.second);
+                    output = out.str();
+                });
+                string label = string(variant.first) + " -O" + to_string(level);
+                cout << "  " << left << setw(24) << label << right << fixed << setprecision(3)
+                     << setw(9) << seconds * 1000 << " ms" << setw(10) << setprecision(1)
+                     << seconds * 1e9 / iterations << " ns/iteration   -> " << output;
+            }
+        }
+    }
+    return 0;
+}
+
+// One `write` per iteration, of two numbers and a string.
+string chattySource(long iterations)
+{
+    return "i := 0;\n"
+           "repeat\n"
+           "  write i, \"squared\", i * i;\n"
+           "  i := i + 1;\n"
+           "until i >= "
+        + to_string(iterations) + ";\n";
+}
+
+// A program that writes a line per iteration, printed to /dev/null three
+// ways: collected in an ostringstream, as main.cpp used to, through
+// std::ofstream with its default buffer, and through an OutputSink.
+int benchOutput(const vector<string>& args)
+{
+    long iterations = args.empty() ? 1000000 : stol(args[0]);
+    string source = chattySource(iterations);
+    Lexer lexer(source);
+    ParseResult parsed = Parser(lexer).parseProgram();
+    vector<Statement*> program = Optimizer(*parsed.arena, 1).optimize(parsed.statements);
+    cout << "output: " << iterations << " lines" << endl;
+
+    size_t bytes = 0;
+    double seconds = timeBest(3, [&] {
+        istringstream input;
+        ostringstream out;
+        Interpreter(input, out).interpret(program);
+        bytes = out.str().size();
+    });
+    report("ostringstream", seconds, bytes);
+    cout << "    " << bytes / 1024 << " KiB held until the program ends" << endl;
+
+    seconds = timeBest(3, [&] {
+        istringstream input;
+        ofstream out("/dev/null");
+        Interpreter(input, out).interpret(program);
+    });
+    report("ofstream", seconds, bytes);
+
+    size_t writes = 0;
+    seconds = timeBest(3, [&] {
+        int fd = open("/dev/null", O_WRONLY);
+        {
+            istringstream input;
+            OutputSink sink(fd);
+            ostream out(&sink);
+            Interpreter(input, out).interpret(program);
+            out.flush();
+            writes = sink.writeCalls();
+        }
+        close(fd);
+    });
+    report("OutputSink", seconds, bytes);
+    cout << "    " << writes << " write() calls for " << iterations << " lines" << endl;
+    return 0;
+}
+
+// `read` as it was before InputBuffer: a fresh regex per word, then stof().
+float regexReadValue(istream& input)
+{
+    string word;
+    input >> word;
+    if (!regex_match(word, regex(R"(^-?\d+$)"))) {
+        throw runtime_error("Invalid input: " + word);
+    }
+    return stof(word);
+}
+
+// Parses `values` random integers of up to 9 digits, one per `read`: with
+// the old regex check (on a sample), from an istringstream, and from an
+// InputBuffer over a mapped file.
+int benchRead(const vector<string>& args)
+{
+    long values = args.empty() ? 2000000 : stol(args[0]);
+    mt19937 random(7);
+    uniform_int_distribution<int> number(-999999999, 999999999);
+    string text;
+    for (long i = 0; i < values; i++) {
+        text += to_string(number(random) >> (i % 24));
+        text += i % 8 == 7 ? '\n' : ' ';
+    }
+    char path[] = "/tmp/tiny-bench-read-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text.data(), text.size()) != ssize_t(text.size())) {
+        cerr << "read: could not write " << path << endl;
+        return 1;
+    }
+    unlink(path);
+    cout << "read: " << values << " values, " << text.size() / (1 << 20) << " MB" << endl;
+
+    Token identifier(Token::Type::IDENTIFIER, "x", 1, 1, 1, 2);
+    float sum = 0;
+    auto row = [&](const char* label, double seconds, long count) {
+        cout << "  " << left << setw(24) << label << right << fixed << setprecision(1) << setw(9)
+             << seconds * 1e9 / count << " ns/value" << endl;
+    };
+
+    // The regex reader is slow enough that a sample of the input will do.
+    long sample = min(values, 100000L);
+    row("regex + stof", timeBest(1, [&] {
+        istringstream input(text);
+        for (long i = 0; i < sample; i++) {
+            sum += regexReadValue(input);
+        }
+    }), sample);
+
+    row("istringstream", timeBest(3, [&] {
+        istringstream input(text);
+        for (long i = 0; i < values; i++) {
+            sum += readInputValue(input, identifier);
+        }
+    }), values);
+
+    row("InputBuffer, mapped", timeBest(3, [&] {
+        lseek(fd, 0, SEEK_SET);
+        InputBuffer buffer(fd);
+        istream input(&buffer);
+        for (long i = 0; i < values; i++) {
+            sum += readInputValue(input, identifier);
+        }
+    }), values);
+    cout << "  (checksum " << sum << ")" << endl;
+    close(fd);
+    return 0;
+}
+
+// Output, or "Error: ..." after whatever was written, of `program` on `engine`.
+string runProgram(const vector<Statement*>& program, Interpreter::Engine engine, bool integers = false)
+{
+    istringstream input;
+    ostringstream out;
+    Interpreter interpreter(input, out);
+    interpreter.setEngine(engine);
+    interpreter.setIntegerArithmetic(integers);
+    try {
+        interpreter.interpret(program);
+    } catch (const exception& e) {
+        out << "Error: " << e.what() << "\n";
+    }
+    return out.str();
+}
+
+// Not a benchmark: runs random loop programs on the JIT and on the tree
+// walker, at each optimization level, and fails on the first one whose
+// output differs from the unoptimized tree walker's.
+int benchJitDiff(const vector<string>& args)
+{
+    int programs = args.empty() ? 2000 : stoi(args[0]);
+    unsigned firstSeed = args.size() < 2 ? 1 : stoul(args[1]);
+    if (!LoopJit::isSupported()) {
+        cout << "jit-diff: no JIT on this platform" << endl;
+        return 0;
+    }
+
+    size_t compiled = 0, errors = 0;
+    for (int i = 0; i < programs; i++) {
+        unsigned seed = firstSeed + i;
+        string source = LoopProgramGenerator(seed).program();
+        Lexer lexer(source);
+        ParseResult parsed = Parser(lexer).parseProgram();
+        if (parsed.isError()) {
+            cerr << "seed " << seed << ": generated program does not parse:\n" << source;
+            return 1;
+        }
+        string expected = runProgram(parsed.statements, Interpreter::Engine::TreeWalk);
+        errors += expected.find("Error: ") != string::npos;
+        for (int level = 0; level <= 2; level++) {
+            vector<Statement*> program = Optimizer(*parsed.arena, level).optimize(parsed.statements);
+            SymbolRegistry symbols;
+            LoopJit probe(symbols);
+            probe.compile(program);
+            compiled += probe.compiledLoops();
+
+            for (Interpreter::Engine engine : { Interpreter::Engine::TreeWalk, Interpreter::Engine::Jit }) {
+                string actual = runProgram(program, engine);
+                if (actual != expected) {
+                    cerr << "seed " << seed << " at -O" << level << ": "
+                         << (engine == Interpreter::Engine::Jit ? "jit" : "tree") << " differs from the unoptimized interpreter\n"
+                         << source << "--- expected\n" << expected << "--- actual\n" << actual;
+                    return 1;
+                }
+            }
+        }
+    }
+    cout << "jit-diff: " << programs << " programs agree at -O0 to -O2 (" << compiled << " loops compiled, "
+         << errors << " runs ending in an error)" << endl;
+    return 0;
+}
+
+// Not a benchmark: runs random loop programs, with numbers around 2^24, on
+// the VM's int64 path at each optimization level, and fails on the first
+// one whose output differs from -O0's. Constants the optimizer decodes or
+// folds must keep the integers exact, and values that overflow int64_t must
+// send the VM to its float fallback at the same point at every level.
+int benchInt64Diff(const vector<string>& args)
+{
+    int programs = args.empty() ? 2000 : stoi(args[0]);
+    unsigned firstSeed = args.size() < 2 ? 1 : stoul(args[1]);
+
+    size_t errors = 0;
+    for (int i = 0; i < programs; i++) {
+        unsigned seed = firstSeed + i;
+        string source = LoopProgramGenerator(seed, true).program();
+        Lexer lexer(source);
+        ParseResult parsed = Parser(lexer).parseProgram();
+        if (parsed.isError()) {
+            cerr << "seed " << seed << ": generated program does not parse:\n" << source;
+            return 1;
+        }
+        string expected = runProgram(parsed.statements, Interpreter::Engine::Vm, true);
+        errors += expected.find("Error: ") != string::npos;
+        for (int level = 1; level <= 2; level++) {
+            vector<Statement*> program = Optimizer(*parsed.arena, level, true).optimize(parsed.statements);
+            string actual = runProgram(program, Interpreter::Engine::Vm, true);
+            if (actual != expected) {
+                cerr << "seed " << seed << " at -O" << level << ": vm --int64 differs from -O0\n"
+                     << source << "--- expected\n" << expected << "--- actual\n" << actual;
+                return 1;
+            }
+        }
+    }
+    cout << "int64-diff: " << programs << " programs agree at -O0 to -O2 (" << errors << " runs ending in an error)"
+         << endl;
+    return 0;
+}
+
+int benchAst(const vector<string>& args)
+{
+    size_t megabytes = args.empty() ? 8 : stoul(args[0]);
+    string source = statementHeavySource(megabytes << 20);
+    Lexer lexer(source);
+    Parser parser(lexer);
+    ParseResult parsed = parser.parseProgram();
+    FlatProgram flat;
+    double seconds = timeBest(3, [&] { flat = FlatProgram::flatten(parsed.statements); });
+
+    cout << "ast: " << source.size() / (1 << 20) << " MB of statement-heavy source" << endl;
+    cout << "  pointer tree   " << setw(8) << parsed.arena->bytesUsed() / 1024 << " KiB" << endl;
+    cout << "  flat program   " << setw(8) << flat.bytesUsed() / 1024 << " KiB (" << flat.nodeCount() << " nodes, "
+         << fixed << setprecision(1) << double(parsed.arena->bytesUsed()) / flat.bytesUsed() << "x smaller)" << endl;
+    report("flatten", seconds, source.size());
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    map<string, function<int(const vector<string>&)>> benchmarks = {
+        { "scan", benchScan },
+        { "tokenize", benchTokenize },
+        { "lex-parallel", benchLexParallel },
+        { "ast", benchAst },
+        { "artifact", benchArtifact },
+        { "interpret", benchInterpret },
+        { "binary-ops", benchBinaryOps },
+        { "output", benchOutput },
+        { "read", benchRead },
+        { "jit-diff", benchJitDiff },
+        { "int64-diff", benchInt64Diff },
+        { "parse", benchParse },
+        { "parse-parallel", benchParseParallel },
+    };
+
+    if (argc < 2 || !benchmarks.count(argv[1])) {
+        cerr << "Usage: " << argv[0] << " <benchmark> [options]\nBenchmarks:";
+        for (const auto& entry : benchmarks) {
+            cerr << " " << entry.first;
+        }
+        cerr << endl;
+        return 1;
+    }
+    return benchmarks[argv[1]](vector<string>(argv + 2, argv + argc));
+}
@@ -0,0 +1,621 @@
+#include "bytecode.h"
+#include "expr.h"
+#include "outputSink.h"
+#include "typeInference.h"
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+static_assert(sizeof(BytecodeProgram::Instruction) == 16, "instructions are meant to pack into 16 bytes");
+
+class BytecodeCompiler {
+public:
+    using Op = BytecodeProgram::Op;
+
+    BytecodeProgram program;
+
+    BytecodeCompiler(SymbolRegistry& symbols, const TypeInference* types)
+        : symbols(symbols)
+        , types(types)
+    {
+    }
+
+    void compile(const std::vector<Statement*>& statements)
+    {
+        // Variables and constants get the first registers, so find them all
+        // before emitting anything.
+        for (const Statement* stmt : statements) {
+            declare(stmt);
+        }
+        program.variables = static_cast<uint32_t>(symbols.size());
+        temporaries = program.variables + static_cast<uint32_t>(program.constants.size());
+        program.registers = temporaries;
+        for (uint32_t slot = 0; slot < program.variables; slot++) {
+            assigned.push_back(symbols.isDefined(slot));
+            program.integerVariables.push_back(types && types->isInteger(symbols.name(slot)));
+        }
+        integerRegisters.assign(program.integerVariables.begin(), program.integerVariables.end());
+        integerRegisters.insert(integerRegisters.end(), integerConstants.begin(), integerConstants.end());
+
+        for (const Statement* stmt : statements) {
+            statement(stmt);
+        }
+        emit(Op::Halt);
+    }
+
+private:
+    static constexpr uint32_t NO_REGISTER = UINT32_MAX;
+
+    SymbolRegistry& symbols;
+    // Null unless compiling for the integer registers.
+    const TypeInference* types;
+    std::unordered_map<uint32_t, uint32_t> constantRegisters;
+    std::unordered_map<int64_t, uint32_t> integerConstantRegisters;
+    // Which constants, and then which registers, are on the integer file.
+    // A temporary's type is that of the last value the compiler put in it.
+    std::vector<bool> integerConstants;
+    std::vector<bool> integerRegisters;
+    // First temporary register, and the next free one.
+    uint32_t temporaries = 0;
+    uint32_t nextTemporary = 0;
+    // Variables assigned on every path to the code being emitted; reads of
+    // these need no Check.
+    std::vector<bool> assigned;
+    // The unit being emitted.
+    uint32_t unit = 0;
+
+    // Starts a unit the integer program can go on from in its fallback.
+    void startUnit()
+    {
+        unit = static_cast<uint32_t>(program.units.size());
+        program.units.push_back(static_cast<uint32_t>(program.code.size()));
+    }
+
+    void declare(const Statement* stmt)
+    {
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            symbols.slot(assignment->getIdentifier().lexeme);
+            declare(assignment->getExpression());
+        } else if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            declare(ifStmt->getCondition());
+            for (const Statement* inner : ifStmt->getThenBranch()) {
+                declare(inner);
+            }
+            for (const Statement* inner : ifStmt->getElseBranch()) {
+                declare(inner);
+            }
+        } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            for (const Statement* inner : repeat->getBody()) {
+                declare(inner);
+            }
+            declare(repeat->getCondition());
+        } else if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+            for (const Expr* operand : write->getOperands()) {
+                declare(operand);
+            }
+        } else if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                symbols.slot(identifier.lexeme);
+            }
+        }
+    }
+
+    void declare(const Expr* e)
+    {
+        float value;
+        int64_t integer;
+        std::string error;
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            declare(binary->getLeft());
+            declare(binary->getRight());
+        } else if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            declare(grouping->getExpression());
+        } else if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            symbols.slot(variable->getIdentifier().lexeme);
+        } else if (types && TypeInference::integerConstant(e, integer)) {
+            // Also holds the float it converts to, which is what the literal
+            // decodes to, for float expressions that use it.
+            if (integerConstantRegisters.emplace(integer, static_cast<uint32_t>(program.constants.size())).second) {
+                addConstant(static_cast<float>(integer), integer, true);
+            }
+        } else if (decode(e, value, error)) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            if (constantRegisters.emplace(bits, static_cast<uint32_t>(program.constants.size())).second) {
+                addConstant(value, 0, false);
+            }
+        }
+    }
+
+    void addConstant(float value, int64_t integer, bool isInteger)
+    {
+        program.constants.push_back(value);
+        program.integerConstants.push_back(integer);
+        integerConstants.push_back(isInteger);
+    }
+
+    // The value of a number or constant, decoded as NumberExpr::eval()
+    // would; false with the error it would throw if it cannot be.
+    static bool decode(const Expr* e, float& value, std::string& error)
+    {
+        if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+            value = constant->getValue();
+            return true;
+        }
+        if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+            SymbolRegistry noSymbols;
+            try {
+                value = number->eval(noSymbols);
+                return true;
+            } catch (const std::exception& thrown) {
+                error = thrown.what();
+            }
+        }
+        return false;
+    }
+
+    void statement(const Statement* stmt)
+    {
+        if (stmt == nullptr) {
+            return;
+        }
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            uint32_t slot = symbols.slot(assignment->getIdentifier().lexeme);
+            const Expr* e = assignment->getExpression();
+            startUnit();
+            if (!integerRegisters[slot] && types && types->isInteger(e)) {
+                emit(Op::ToFloat, slot, expr(e));
+            } else {
+                uint32_t value = expr(e, slot);
+                if (value != slot) {
+                    emit(integerRegisters[slot] ? Op::MoveInt : Op::Move, slot, value);
+                }
+            }
+            define(slot);
+            return;
+        }
+        if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            startUnit();
+            uint32_t condition = expr(ifStmt->getCondition());
+            size_t toElse = emit(integerRegisters[condition] ? Op::JumpIfZeroInt : Op::JumpIfZero, 0, condition);
+            std::vector<bool> before = assigned;
+            for (const Statement* inner : ifStmt->getThenBranch()) {
+                statement(inner);
+            }
+            if (ifStmt->getElseBranch().empty()) {
+                patch(toElse);
+            } else {
+                size_t toEnd = emit(Op::Jump);
+                patch(toElse);
+                std::vector<bool> afterThen = assigned;
+                assigned = before;
+                for (const Statement* inner : ifStmt->getElseBranch()) {
+                    statement(inner);
+                }
+                patch(toEnd);
+                for (size_t i = 0; i < assigned.size(); i++) {
+                    assigned[i] = assigned[i] && afterThen[i];
+                }
+                return;
+            }
+            assigned = before;
+            return;
+        }
+        if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            // What the first pass through the body assigns holds for every
+            // later pass and for the condition too.
+            uint32_t top = static_cast<uint32_t>(program.code.size());
+            for (const Statement* inner : repeat->getBody()) {
+                statement(inner);
+            }
+            startUnit();
+            uint32_t condition = expr(repeat->getCondition());
+            emit(integerRegisters[condition] ? Op::JumpIfZeroInt : Op::JumpIfZero, top, condition);
+            return;
+        }
+        if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+            for (const Expr* operand : write->getOperands()) {
+                startUnit();
+                if (auto literal = dynamic_cast<const LiteralExpr*>(operand)) {
+                    emitAt(Op::WriteText, intern(program.texts, literal->getValue()));
+                } else {
+                    uint32_t value = expr(operand);
+                    emit(integerRegisters[value] ? Op::WriteInt : Op::WriteValue, 0, value);
+                }
+            }
+            emit(Op::WriteEnd);
+            return;
+        }
+        if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                uint32_t slot = symbols.slot(identifier.lexeme);
+                program.reads.push_back(identifier);
+                startUnit();
+                emitAt(integerRegisters[slot] ? Op::ReadInt : Op::Read, static_cast<uint32_t>(program.reads.size() - 1), slot, 0, unit);
+                assigned[slot] = true;
+            }
+            return;
+        }
+        throw std::runtime_error("Cannot compile statement: " + stmt->toString());
+    }
+
+    // Emits code for `e` and returns the register holding its value. A
+    // computed value is put in `target` if one is given; variables and
+    // constants are returned as their own register instead.
+    uint32_t expr(const Expr* e, uint32_t target = NO_REGISTER)
+    {
+        float value;
+        int64_t integer;
+        std::string error;
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            if (types && types->isInteger(e)) {
+                return integerBinary(binary, target);
+            }
+            uint32_t mark = nextTemporary;
+            uint32_t left = toFloat(expr(binary->getLeft()));
+            uint32_t right = toFloat(expr(binary->getRight()));
+            nextTemporary = mark;
+            uint32_t result = target != NO_REGISTER ? target : temporary(false);
+            const Token& op = binary->getOperator();
+            switch (op.type) {
+            case Token::Type::PLUS: emit(Op::Add, result, left, right); break;
+            case Token::Type::MINUS: emit(Op::Subtract, result, left, right); break;
+            case Token::Type::MULTIPLY: emit(Op::Multiply, result, left, right); break;
+            case Token::Type::DIVIDE:
+                emitAt(Op::Divide, message("Division by zero at operator '" + string(op.lexeme) + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column)), result, left, right);
+                break;
+            case Token::Type::LESS_THAN: emit(Op::Less, result, left, right); break;
+            case Token::Type::LESS_EQUAL: emit(Op::LessEqual, result, left, right); break;
+            case Token::Type::GREATER_THAN: emit(Op::Greater, result, left, right); break;
+            case Token::Type::GREATER_EQUAL: emit(Op::GreaterEqual, result, left, right); break;
+            case Token::Type::EQUAL: emit(Op::Equal, result, left, right); break;
+            case Token::Type::NOT_EQUAL: emit(Op::NotEqual, result, left, right); break;
+            default:
+                emitAt(Op::Fail, message("Unknown operator: '" + string(op.lexeme) + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column)));
+                break;
+            }
+            return result;
+        }
+        if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            return expr(grouping->getExpression(), target);
+        }
+        if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            const Token& identifier = variable->getIdentifier();
+            uint32_t slot = symbols.slot(identifier.lexeme);
+            if (!assigned[slot]) {
+                emitAt(Op::Check, message("Undefined variable: '" + string(identifier.lexeme) + "' at line " + to_string(identifier.start_line) + ", column " + to_string(identifier.start_column)), slot);
+                assigned[slot] = true;
+            }
+            return slot;
+        }
+        if (types && TypeInference::integerConstant(e, integer)) {
+            return program.variables + integerConstantRegisters.at(integer);
+        }
+        if (decode(e, value, error)) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return program.variables + constantRegisters.at(bits);
+        }
+        if (dynamic_cast<const LiteralExpr*>(e)) {
+            error = "Invalid literal type for evaluation";
+        } else if (error.empty()) {
+            throw std::runtime_error("Cannot compile expression: " + e->toString());
+        }
+        emitAt(Op::Fail, message(error));
+        return target != NO_REGISTER ? target : temporary(false);
+    }
+
+    // An integer +, -, * or comparison, whose operands are integers too.
+    uint32_t integerBinary(const BinaryExpr* binary, uint32_t target)
+    {
+        uint32_t mark = nextTemporary;
+        uint32_t left = expr(binary->getLeft());
+        uint32_t right = expr(binary->getRight());
+        nextTemporary = mark;
+        uint32_t result = target != NO_REGISTER ? target : temporary(true);
+        const Token& op = binary->getOperator();
+        switch (op.type) {
+        case Token::Type::PLUS: emitAt(Op::AddInt, unit, result, left, right); break;
+        case Token::Type::MINUS: emitAt(Op::SubtractInt, unit, result, left, right); break;
+        case Token::Type::MULTIPLY: emitAt(Op::MultiplyInt, unit, result, left, right); break;
+        case Token::Type::LESS_THAN: emit(Op::LessInt, result, left, right); break;
+        case Token::Type::LESS_EQUAL: emit(Op::LessEqualInt, result, left, right); break;
+        case Token::Type::GREATER_THAN: emit(Op::GreaterInt, result, left, right); break;
+        case Token::Type::GREATER_EQUAL: emit(Op::GreaterEqualInt, result, left, right); break;
+        case Token::Type::EQUAL: emit(Op::EqualInt, result, left, right); break;
+        case Token::Type::NOT_EQUAL: emit(Op::NotEqualInt, result, left, right); break;
+        default: throw std::runtime_error("Cannot compile integer expression: " + binary->toString());
+        }
+        return result;
+    }
+
+    // `index` as a float register: itself, or an integer converted into a
+    // temporary. Integer constants also hold their float value.
+    uint32_t toFloat(uint32_t index)
+    {
+        if (!integerRegisters[index] || (index >= program.variables && index < temporaries)) {
+            return index;
+        }
+        uint32_t result = temporary(false);
+        emit(Op::ToFloat, result, index);
+        return result;
+    }
+
+    void define(uint32_t slot)
+    {
+        if (!assigned[slot]) {
+            emit(Op::Define, slot);
+            assigned[slot] = true;
+        }
+    }
+
+    uint32_t temporary(bool integer)
+    {
+        uint32_t index = temporaries + nextTemporary++;
+        program.registers = std::max(program.registers, index + 1);
+        if (integerRegisters.size() <= index) {
+            integerRegisters.resize(index + 1);
+        }
+        integerRegisters[index] = integer;
+        return index;
+    }
+
+    uint32_t message(std::string text)
+    {
+        return intern(program.messages, std::move(text));
+    }
+
+    static uint32_t intern(std::vector<std::string>& pool, std::string text)
+    {
+        pool.push_back(std::move(text));
+        return static_cast<uint32_t>(pool.size() - 1);
+    }
+
+    size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+    {
+        return emitAt(op, 0, a, b, c);
+    }
+
+    size_t emitAt(Op op, uint32_t site, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+    {
+        BytecodeProgram::Instruction instruction {};
+        instruction.op = static_cast<uint32_t>(op);
+        instruction.site = site;
+        instruction.a = a;
+        instruction.b = b;
+        instruction.c = c;
+        program.code.push_back(instruction);
+        return program.code.size() - 1;
+    }
+
+    // Points the jump at `index` to the next instruction.
+    void patch(size_t index)
+    {
+        program.code[index].a = static_cast<uint32_t>(program.code.size());
+    }
+};
+
+namespace {
+
+// Thrown by the integer program to go on in its fallback from `unit`. A
+// read that gave a float also passes the variable and its value.
+struct Deoptimization {
+    uint32_t unit;
+    uint32_t slot;
+    float value;
+};
+
+} // namespace
+
+BytecodeProgram BytecodeProgram::compile(const std::vector<Statement*>& statements, SymbolRegistry& symbols, bool integers)
+{
+    if (!integers) {
+        BytecodeCompiler compiler(symbols, nullptr);
+        compiler.compile(statements);
+        return std::move(compiler.program);
+    }
+    // Compiled first, so both programs give each variable the same slot.
+    auto fallback = std::make_shared<BytecodeProgram>(compile(statements, symbols, false));
+    TypeInference types = TypeInference::infer(statements, symbols);
+    BytecodeCompiler compiler(symbols, &types);
+    compiler.compile(statements);
+    compiler.program.fallback = std::move(fallback);
+    return std::move(compiler.program);
+}
+
+void BytecodeProgram::execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const
+{
+    std::vector<float> file(registers);
+    std::vector<uint8_t> defined(variables);
+    for (uint32_t slot = 0; slot < variables; slot++) {
+        if (symbols.isDefined(slot)) {
+            file[slot] = symbols.get(slot);
+            defined[slot] = 1;
+        }
+    }
+    std::copy(constants.begin(), constants.end(), file.begin() + variables);
+    std::vector<int64_t> integerFile(registers);
+    std::copy(integerConstants.begin(), integerConstants.end(), integerFile.begin() + variables);
+    run(file, integerFile, defined, 0, symbols, input, output);
+}
+
+// Runs the code from instruction `from` on the given registers.
+void BytecodeProgram::run(std::vector<float>& file, std::vector<int64_t>& integerFile, std::vector<uint8_t>& defined, size_t from,
+    SymbolRegistry& symbols, std::istream& input, std::ostream& output) const
+{
+    // Variables go back to the registry however the program ends.
+    auto store = [&] {
+        for (uint32_t slot = 0; slot < variables; slot++) {
+            if (defined[slot]) {
+                symbols.set(slot, integerVariables[slot] ? static_cast<float>(integerFile[slot]) : file[slot]);
+            }
+        }
+    };
+
+    float* r = file.data();
+    int64_t* n = integerFile.data();
+    const Instruction* pc = code.data() + from;
+    try {
+        while (true) {
+            const Instruction& in = *pc++;
+            switch (static_cast<Op>(in.op)) {
+            case Op::Add: r[in.a] = r[in.b] + r[in.c]; break;
+            case Op::Subtract: r[in.a] = r[in.b] - r[in.c]; break;
+            case Op::Multiply: r[in.a] = r[in.b] * r[in.c]; break;
+            case Op::Divide:
+                if (r[in.c] == 0) {
+                    throw std::runtime_error(messages[in.site]);
+                }
+                r[in.a] = r[in.b] / r[in.c];
+                break;
+            case Op::Less: r[in.a] = r[in.b] < r[in.c] ? 1 : 0; break;
+            case Op::LessEqual: r[in.a] = r[in.b] <= r[in.c] ? 1 : 0; break;
+            case Op::Greater: r[in.a] = r[in.b] > r[in.c] ? 1 : 0; break;
+            case Op::GreaterEqual: r[in.a] = r[in.b] >= r[in.c] ? 1 : 0; break;
+            case Op::Equal: r[in.a] = r[in.b] == r[in.c] ? 1 : 0; break;
+            case Op::NotEqual: r[in.a] = r[in.b] != r[in.c] ? 1 : 0; break;
+            case Op::Move: r[in.a] = r[in.b]; break;
+            case Op::Check:
+                if (!defined[in.a]) {
+                    throw std::runtime_error(messages[in.site]);
+                }
+                break;
+            case Op::Define: defined[in.a] = 1; break;
+            case Op::Jump: pc = code.data() + in.a; break;
+            case Op::JumpIfZero:
+                if (r[in.b] == 0) {
+                    pc = code.data() + in.a;
+                }
+                break;
+            case Op::WriteValue: output << r[in.b]; break;
+            case Op::WriteText: output << texts[in.site]; break;
+            case Op::WriteEnd: endLine(output); break;
+            case Op::Read:
+                r[in.a] = readInputValue(input, reads[in.site]);
+                defined[in.a] = 1;
+                break;
+            case Op::Fail: throw std::runtime_error(messages[in.site]);
+            case Op::Halt:
+                store();
+                return;
+            // The target may be a variable the fallback needs unchanged.
+            case Op::AddInt: {
+                int64_t sum;
+                if (__builtin_add_overflow(n[in.b], n[in.c], &sum)) {
+                    throw Deoptimization { in.site, 0, 0 };
+                }
+                n[in.a] = sum;
+                break;
+            }
+            case Op::SubtractInt: {
+                int64_t difference;
+                if (__builtin_sub_overflow(n[in.b], n[in.c], &difference)) {
+                    throw Deoptimization { in.site, 0, 0 };
+                }
+                n[in.a] = difference;
+                break;
+            }
+            case Op::MultiplyInt: {
+                // Float makes 0 times a negative number -0.
+                int64_t product;
+                if (__builtin_mul_overflow(n[in.b], n[in.c], &product) || (product == 0 && (n[in.b] | n[in.c]) < 0)) {
+                    throw Deoptimization { in.site, 0, 0 };
+                }
+                n[in.a] = product;
+                break;
+            }
+            case Op::LessInt: n[in.a] = n[in.b] < n[in.c]; break;
+            case Op::LessEqualInt: n[in.a] = n[in.b] <= n[in.c]; break;
+            case Op::GreaterInt: n[in.a] = n[in.b] > n[in.c]; break;
+            case Op::GreaterEqualInt: n[in.a] = n[in.b] >= n[in.c]; break;
+            case Op::EqualInt: n[in.a] = n[in.b] == n[in.c]; break;
+            case Op::NotEqualInt: n[in.a] = n[in.b] != n[in.c]; break;
+            case Op::MoveInt: n[in.a] = n[in.b]; break;
+            case Op::ToFloat: r[in.a] = static_cast<float>(n[in.b]); break;
+            case Op::JumpIfZeroInt:
+                if (n[in.b] == 0) {
+                    pc = code.data() + in.a;
+                }
+                break;
+            case Op::WriteInt: output << n[in.b]; break;
+            case Op::ReadInt: {
+                float value;
+                if (!readInputInteger(input, reads[in.site], n[in.a], value)) {
+                    throw Deoptimization { in.c, in.a, value };
+                }
+                defined[in.a] = 1;
+                break;
+            }
+            }
+        }
+    } catch (const Deoptimization& deoptimization) {
+        // The fallback shares the variable slots; its constants and
+        // temporaries are its own.
+        std::vector<float> fallbackFile(fallback->registers);
+        for (uint32_t slot = 0; slot < variables; slot++) {
+            fallbackFile[slot] = integerVariables[slot] ? static_cast<float>(n[slot]) : r[slot];
+        }
+        std::copy(fallback->constants.begin(), fallback->constants.end(), fallbackFile.begin() + variables);
+        std::vector<int64_t> fallbackIntegers(fallback->registers);
+        size_t resume = fallback->units[deoptimization.unit];
+        if (static_cast<Op>(code[units[deoptimization.unit]].op) == Op::ReadInt) {
+            // The read itself is done.
+            fallbackFile[deoptimization.slot] = deoptimization.value;
+            defined[deoptimization.slot] = 1;
+            resume++;
+        }
+        fallback->run(fallbackFile, fallbackIntegers, defined, resume, symbols, input, output);
+    } catch (...) {
+        store();
+        throw;
+    }
+}
+
+std::string BytecodeProgram::disassemble() const
+{
+    static const char* const names[] = {
+        "add", "sub", "mul", "div", "lt", "le", "gt", "ge", "eq", "ne",
+        "move", "check", "define", "jump", "jz", "write", "write.text", "write.end", "read", "fail", "halt",
+        "add.i", "sub.i", "mul.i", "lt.i", "le.i", "gt.i", "ge.i", "eq.i", "ne.i",
+        "move.i", "to.float", "jz.i", "write.i", "read.i",
+    };
+    auto reg = [&](uint32_t index) {
+        if (index < variables) {
+            return "r" + std::to_string(index);
+        }
+        if (index < variables + constants.size()) {
+            if (integerConstants[index - variables] != 0) {
+                return "#" + std::to_string(integerConstants[index - variables]);
+            }
+            std::ostringstream text;
+            text << "#" << constants[index - variables];
+            return text.str();
+        }
+        return "t" + std::to_string(index - variables - constants.size());
+    };
+
+    std::string result;
+    for (size_t i = 0; i < code.size(); i++) {
+        const Instruction& in = code[i];
+        Op op = static_cast<Op>(in.op);
+        result += std::to_string(i) + "\t" + names[in.op];
+        if (op <= Op::NotEqual || (op >= Op::AddInt && op <= Op::NotEqualInt)) {
+            result += " " + reg(in.a) + ", " + reg(in.b) + ", " + reg(in.c);
+        } else if (op == Op::Move || op == Op::MoveInt || op == Op::ToFloat) {
+            result += " " + reg(in.a) + ", " + reg(in.b);
+        } else if (op == Op::Check || op == Op::Define || op == Op::Read || op == Op::ReadInt) {
+            result += " " + reg(in.a);
+        } else if (op == Op::Jump) {
+            result += " " + std::to_string(in.a);
+        } else if (op == Op::JumpIfZero || op == Op::JumpIfZeroInt) {
+            result += " " + reg(in.b) + ", " + std::to_string(in.a);
+        } else if (op == Op::WriteValue || op == Op::WriteInt) {
+            result += " " + reg(in.b);
+        } else if (op == Op::WriteText) {
+            result += " \"" + texts[in.site] + "\"";
+        }
+        result += "\n";
+    }
+    return result;
+}
@@ -0,0 +1,403 @@
+#include "cBackend.h"
+#include "expr.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+
+extern char** environ;
+
+namespace {
+
+// Runtime support every emitted program starts with.
+const char* const PRELUDE = R"(#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma STDC FP_CONTRACT OFF
+
+static void tiny_fail(const char* message)
+{
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", message);
+    exit(1);
+}
+
+static float tiny_bits(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+/* The next whitespace-separated word of input as an integer, like
+   readInputValue(). */
+static float tiny_read(const char* name, int line, int column)
+{
+    static char* word;
+    static size_t capacity;
+    size_t length = 0;
+    int c;
+    do {
+        c = getchar();
+    } while (c != EOF && isspace(c));
+    for (;;) {
+        if (length + 1 >= capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            word = realloc(word, capacity);
+            if (word == NULL) {
+                tiny_fail("out of memory");
+            }
+        }
+        if (c == EOF || isspace(c)) {
+            break;
+        }
+        word[length++] = (char)c;
+        c = getchar();
+    }
+    word[length] = '\0';
+
+    size_t i = word[0] == '-' ? 1 : 0;
+    int valid = length > i;
+    for (; i < length; i++) {
+        valid = valid && word[i] >= '0' && word[i] <= '9';
+    }
+    if (!valid) {
+        const char* format = "Invalid input for variable '%s': %s at line %d, column %d";
+        int size = snprintf(NULL, 0, format, name, word, line, column);
+        char* message = malloc((size_t)size + 1);
+        if (message == NULL) {
+            tiny_fail("out of memory");
+        }
+        snprintf(message, (size_t)size + 1, format, name, word, line, column);
+        tiny_fail(message);
+    }
+    errno = 0;
+    float value = strtof(word, NULL);
+    if (errno == ERANGE) {
+        tiny_fail("stof");
+    }
+    return value;
+}
+
+)";
+
+std::string quote(std::string_view text)
+{
+    std::string result = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\' || c == '?') {
+            result += '\\';
+            result += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            result += escape;
+        } else {
+            result += static_cast<char>(c);
+        }
+    }
+    return result + "\"";
+}
+
+// A C expression with exactly the float value `value`.
+std::string floatLiteral(float value)
+{
+    char text[64];
+    if (std::isfinite(value)) {
+        std::snprintf(text, sizeof(text), "%af", static_cast<double>(value));
+    } else {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        std::snprintf(text, sizeof(text), "tiny_bits(0x%08xu)", bits);
+    }
+    return text;
+}
+
+std::string at(const std::string& what, const Token& token)
+{
+    return what + " at line " + std::to_string(token.start_line) + ", column " + std::to_string(token.start_column);
+}
+
+} // namespace
+
+class CProgramWriter {
+public:
+    std::string program(const std::vector<Statement*>& statements)
+    {
+        indent = 1;
+        for (const Statement* stmt : statements) {
+            statement(stmt);
+        }
+
+        std::string result = PRELUDE;
+        result += "int main(void)\n{\n";
+        result += "    static char buffer[1 << 16];\n";
+        result += "    setvbuf(stdout, buffer, _IOFBF, sizeof buffer);\n";
+        for (const std::string& name : names) {
+            result += "    float v_" + name + " = 0;\n";
+            result += "    int d_" + name + " = 0;\n";
+        }
+        result += body;
+        result += "    return 0;\n}\n";
+        return result;
+    }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string_view, size_t> variables;
+    // Variables assigned on every path to the code being emitted; reads of
+    // these need no check.
+    std::vector<bool> assigned;
+    std::string body;
+    int indent = 0;
+    int temporaries = 0;
+
+    void line(const std::string& text)
+    {
+        body += std::string(4 * indent, ' ') + text + "\n";
+    }
+
+    // Index of the variable called `name`, declared on first use.
+    size_t variable(std::string_view name)
+    {
+        auto it = variables.find(name);
+        if (it != variables.end()) {
+            return it->second;
+        }
+        // Identifiers are C-safe already; anything else is spelled out.
+        std::string mangled;
+        for (unsigned char c : name) {
+            if (std::isalnum(c) || c == '_') {
+                mangled += static_cast<char>(c);
+            } else {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "_x%02X", c);
+                mangled += escape;
+            }
+        }
+        names.push_back(mangled);
+        assigned.push_back(false);
+        variables.emplace(name, names.size() - 1);
+        return names.size() - 1;
+    }
+
+    void assign(size_t index, const std::string& value)
+    {
+        line("v_" + names[index] + " = " + value + ";");
+        if (!assigned[index]) {
+            line("d_" + names[index] + " = 1;");
+            assigned[index] = true;
+        }
+    }
+
+    void block(const ArenaList<Statement*>& stmts)
+    {
+        indent++;
+        for (const Statement* stmt : stmts) {
+            statement(stmt);
+        }
+        indent--;
+    }
+
+    void statement(const Statement* stmt)
+    {
+        if (stmt == nullptr) {
+            return;
+        }
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            std::string value = expr(assignment->getExpression());
+            assign(variable(assignment->getIdentifier().lexeme), value);
+            return;
+        }
+        if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            std::string condition = expr(ifStmt->getCondition());
+            std::vector<bool> before = assigned;
+            line("if (" + condition + " != 0) {");
+            block(ifStmt->getThenBranch());
+            std::vector<bool> afterThen = assigned;
+            // Variables first seen inside a branch are not assigned before it.
+            assigned = before;
+            assigned.resize(names.size(), false);
+            if (!ifStmt->getElseBranch().empty()) {
+                line("} else {");
+                block(ifStmt->getElseBranch());
+            }
+            line("}");
+            afterThen.resize(names.size(), false);
+            for (size_t i = 0; i < assigned.size(); i++) {
+                assigned[i] = assigned[i] && afterThen[i];
+            }
+            return;
+        }
+        if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            // The body runs at least once, so what it assigns holds after
+            // the loop as well.
+            size_t start = body.size();
+            line("do {");
+            block(repeat->getBody());
+            indent++;
+            size_t beforeCondition = body.size();
+            std::string condition = expr(repeat->getCondition());
+            indent--;
+            if (body.size() == beforeCondition) {
+                line("} while (" + condition + " == 0);");
+            } else {
+                // The condition needs statements of its own, which the
+                // while clause cannot see; loop forever and break out.
+                body.replace(start, body.find('\n', start) - start, std::string(4 * indent, ' ') + "for (;;) {");
+                indent++;
+                line("if (" + condition + " != 0) {");
+                line("    break;");
+                line("}");
+                indent--;
+                line("}");
+            }
+            return;
+        }
+        if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+            for (const Expr* operand : write->getOperands()) {
+                if (auto literal = dynamic_cast<const LiteralExpr*>(operand)) {
+                    line("fputs(" + quote(literal->getToken().lexeme) + ", stdout);");
+                } else {
+                    line("printf(\"%g\", (double)" + expr(operand) + ");");
+                }
+            }
+            line("putchar('\\n');");
+            return;
+        }
+        if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                assign(variable(identifier.lexeme), "tiny_read(" + quote(identifier.lexeme) + ", " + std::to_string(identifier.start_line) + ", " + std::to_string(identifier.start_column) + ")");
+            }
+            return;
+        }
+        throw std::runtime_error("Cannot emit statement: " + stmt->toString());
+    }
+
+    // A side-effect-free C expression for `e`. Checks it needs (undefined
+    // variables, division by zero) are emitted as statements first, in the
+    // order BinaryExpr::eval() would make them.
+    std::string expr(const Expr* e)
+    {
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            std::string left = expr(binary->getLeft());
+            std::string right = expr(binary->getRight());
+            const Token& op = binary->getOperator();
+            // Casts round every result to float even where the compiler
+            // evaluates float expressions in more precision.
+            switch (op.type) {
+            case Token::Type::PLUS: return "(float)(" + left + " + " + right + ")";
+            case Token::Type::MINUS: return "(float)(" + left + " - " + right + ")";
+            case Token::Type::MULTIPLY: return "(float)(" + left + " * " + right + ")";
+            case Token::Type::DIVIDE: {
+                std::string divisor = "t" + std::to_string(temporaries++);
+                line("const float " + divisor + " = " + right + ";");
+                line("if (" + divisor + " == 0) {");
+                line("    tiny_fail(" + quote(at("Division by zero at operator '" + std::string(op.lexeme) + "'", op)) + ");");
+                line("}");
+                return "(float)(" + left + " / " + divisor + ")";
+            }
+            case Token::Type::LESS_THAN: return "(" + left + " < " + right + " ? 1.0f : 0.0f)";
+            case Token::Type::LESS_EQUAL: return "(" + left + " <= " + right + " ? 1.0f : 0.0f)";
+            case Token::Type::GREATER_THAN: return "(" + left + " > " + right + " ? 1.0f : 0.0f)";
+            case Token::Type::GREATER_EQUAL: return "(" + left + " >= " + right + " ? 1.0f : 0.0f)";
+            case Token::Type::EQUAL: return "(" + left + " == " + right + " ? 1.0f : 0.0f)";
+            case Token::Type::NOT_EQUAL: return "(" + left + " != " + right + " ? 1.0f : 0.0f)";
+            default:
+                return fail(at("Unknown operator: '" + std::string(op.lexeme) + "'", op));
+            }
+        }
+        if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            return expr(grouping->getExpression());
+        }
+        if (auto variableExpr = dynamic_cast<const VariableExpr*>(e)) {
+            const Token& identifier = variableExpr->getIdentifier();
+            size_t index = variable(identifier.lexeme);
+            if (!assigned[index]) {
+                line("if (!d_" + names[index] + ") {");
+                line("    tiny_fail(" + quote(at("Undefined variable: '" + std::string(identifier.lexeme) + "'", identifier)) + ");");
+                line("}");
+                assigned[index] = true;
+            }
+            return "v_" + names[index];
+        }
+        if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+            return floatLiteral(constant->getValue());
+        }
+        if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+            SymbolRegistry noSymbols;
+            try {
+                return floatLiteral(number->eval(noSymbols));
+            } catch (const std::exception& thrown) {
+                return fail(thrown.what());
+            }
+        }
+        if (dynamic_cast<const LiteralExpr*>(e)) {
+            return fail("Invalid literal type for evaluation");
+        }
+        throw std::runtime_error("Cannot emit expression: " + e->toString());
+    }
+
+    std::string fail(const std::string& message)
+    {
+        line("tiny_fail(" + quote(message) + ");");
+        return "0.0f";
+    }
+};
+
+std::string CBackend::emit(const std::vector<Statement*>& program)
+{
+    return CProgramWriter().program(program);
+}
+
+bool CBackend::compileNative(const std::string& source, const std::string& output, std::string& error)
+{
+    char path[] = "/tmp/tinyXXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if (fd < 0) {
+        error = "could not create a temporary file";
+        return false;
+    }
+    close(fd);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << source;
+    file.close();
+    if (!file) {
+        std::remove(path);
+        error = "could not write " + std::string(path);
+        return false;
+    }
+
+    const char* compiler = std::getenv("CC");
+    std::string cc = compiler != nullptr && *compiler != '\0' ? compiler : "cc";
+    std::vector<std::string> args = { cc, "-std=c99", "-O2", "-ffp-contract=off", "-o", output, path };
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t child;
+    int status = 0;
+    bool ran = posix_spawnp(&child, cc.c_str(), nullptr, nullptr, argv.data(), environ) == 0 && waitpid(child, &status, 0) == child;
+    std::remove(path);
+    if (!ran) {
+        error = "could not run " + cc;
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        error = cc + " failed";
+        return false;
+    }
+    return true;
+}
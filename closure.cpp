@@ -0,0 +1,339 @@
+#include "closure.h"
+#include "expr.h"
+#include "outputSink.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+using Frame = ClosureProgram::Frame;
+using Eval = ClosureProgram::Eval;
+using Exec = ClosureProgram::Exec;
+using Message = std::shared_ptr<const std::string>;
+
+inline float load(Frame& frame, uint32_t slot, const Message& undefined)
+{
+    if (!frame.defined[slot]) {
+        throw std::runtime_error(*undefined);
+    }
+    return frame.values[slot];
+}
+
+struct Add {
+    float operator()(float left, float right) const { return left + right; }
+};
+struct Subtract {
+    float operator()(float left, float right) const { return left - right; }
+};
+struct Multiply {
+    float operator()(float left, float right) const { return left * right; }
+};
+struct Divide {
+    Message byZero;
+    float operator()(float left, float right) const
+    {
+        if (right == 0) {
+            throw std::runtime_error(*byZero);
+        }
+        return left / right;
+    }
+};
+// Division by a constant known not to be zero.
+struct DivideBy {
+    float operator()(float left, float right) const { return left / right; }
+};
+struct Less {
+    float operator()(float left, float right) const { return left < right ? 1 : 0; }
+};
+struct LessEqual {
+    float operator()(float left, float right) const { return left <= right ? 1 : 0; }
+};
+struct Greater {
+    float operator()(float left, float right) const { return left > right ? 1 : 0; }
+};
+struct GreaterEqual {
+    float operator()(float left, float right) const { return left >= right ? 1 : 0; }
+};
+struct Equal {
+    float operator()(float left, float right) const { return left == right ? 1 : 0; }
+};
+struct NotEqual {
+    float operator()(float left, float right) const { return left != right ? 1 : 0; }
+};
+struct Unknown {
+    Message error;
+    float operator()(float left, float right) const { throw std::runtime_error(*error); }
+};
+
+Message at(const std::string& what, const Token& token)
+{
+    return std::make_shared<const std::string>(what + " at line " + std::to_string(token.start_line) + ", column " + std::to_string(token.start_column));
+}
+
+} // namespace
+
+class ClosureCompiler {
+public:
+    explicit ClosureCompiler(SymbolRegistry& symbols)
+        : symbols(symbols)
+    {
+    }
+
+    Exec statements(const std::vector<Statement*>& stmts)
+    {
+        std::vector<Exec> compiled;
+        for (const Statement* stmt : stmts) {
+            if (stmt != nullptr) {
+                compiled.push_back(statement(stmt));
+            }
+        }
+        if (compiled.size() == 1) {
+            return compiled.front();
+        }
+        return [compiled](Frame& frame) {
+            for (const Exec& stmt : compiled) {
+                stmt(frame);
+            }
+        };
+    }
+
+private:
+    // A compiled expression, with what it is when that lets its parent
+    // inline it instead of calling it.
+    struct Compiled {
+        enum class Shape {
+            Other,
+            Variable,
+            Constant,
+        };
+
+        Eval eval;
+        Shape shape = Shape::Other;
+        uint32_t slot = 0;
+        float value = 0;
+        Message undefined;
+    };
+
+    SymbolRegistry& symbols;
+
+    Exec statements(const ArenaList<Statement*>& stmts)
+    {
+        return statements(std::vector<Statement*>(stmts.begin(), stmts.end()));
+    }
+
+    Exec statement(const Statement* stmt)
+    {
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            uint32_t slot = symbols.slot(assignment->getIdentifier().lexeme);
+            Eval value = expr(assignment->getExpression()).eval;
+            return [slot, value](Frame& frame) {
+                float result = value(frame);
+                frame.values[slot] = result;
+                frame.defined[slot] = 1;
+            };
+        }
+        if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            Eval condition = expr(ifStmt->getCondition()).eval;
+            Exec thenBranch = statements(ifStmt->getThenBranch());
+            Exec elseBranch = statements(ifStmt->getElseBranch());
+            return [condition, thenBranch, elseBranch](Frame& frame) {
+                if (condition(frame)) {
+                    thenBranch(frame);
+                } else {
+                    elseBranch(frame);
+                }
+            };
+        }
+        if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            Exec body = statements(repeat->getBody());
+            Eval condition = expr(repeat->getCondition()).eval;
+            return [body, condition](Frame& frame) {
+                do {
+                    body(frame);
+                } while (!condition(frame));
+            };
+        }
+        if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+            // A string operand has no Eval; a number has no text.
+            std::vector<std::pair<Eval, std::string>> operands;
+            for (const Expr* operand : write->getOperands()) {
+                if (auto literal = dynamic_cast<const LiteralExpr*>(operand)) {
+                    operands.emplace_back(nullptr, literal->getValue());
+                } else {
+                    operands.emplace_back(expr(operand).eval, std::string());
+                }
+            }
+            return [operands](Frame& frame) {
+                for (const auto& operand : operands) {
+                    if (operand.first) {
+                        frame.output << operand.first(frame);
+                    } else {
+                        frame.output << operand.second;
+                    }
+                }
+                endLine(frame.output);
+            };
+        }
+        if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            std::vector<std::pair<uint32_t, Token>> targets;
+            for (const Token& identifier : read->getIdentifiers()) {
+                targets.emplace_back(symbols.slot(identifier.lexeme), identifier);
+            }
+            return [targets](Frame& frame) {
+                for (const auto& target : targets) {
+                    frame.values[target.first] = readInputValue(frame.input, target.second);
+                    frame.defined[target.first] = 1;
+                }
+            };
+        }
+        throw std::runtime_error("Cannot compile statement: " + stmt->toString());
+    }
+
+    Compiled expr(const Expr* e)
+    {
+        Compiled compiled;
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            Compiled left = expr(binary->getLeft());
+            Compiled right = expr(binary->getRight());
+            const Token& op = binary->getOperator();
+            switch (op.type) {
+            case Token::Type::PLUS: return combine(Add(), left, right);
+            case Token::Type::MINUS: return combine(Subtract(), left, right);
+            case Token::Type::MULTIPLY: return combine(Multiply(), left, right);
+            case Token::Type::DIVIDE:
+                if (right.shape == Compiled::Shape::Constant && right.value != 0) {
+                    return combine(DivideBy(), left, right);
+                }
+                return combine(Divide { at("Division by zero at operator '" + string(op.lexeme) + "'", op) }, left, right);
+            case Token::Type::LESS_THAN: return combine(Less(), left, right);
+            case Token::Type::LESS_EQUAL: return combine(LessEqual(), left, right);
+            case Token::Type::GREATER_THAN: return combine(Greater(), left, right);
+            case Token::Type::GREATER_EQUAL: return combine(GreaterEqual(), left, right);
+            case Token::Type::EQUAL: return combine(Equal(), left, right);
+            case Token::Type::NOT_EQUAL: return combine(NotEqual(), left, right);
+            default:
+                return combine(Unknown { at("Unknown operator: '" + string(op.lexeme) + "'", op) }, left, right);
+            }
+        }
+        if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            return expr(grouping->getExpression());
+        }
+        if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            const Token& identifier = variable->getIdentifier();
+            compiled.shape = Compiled::Shape::Variable;
+            compiled.slot = symbols.slot(identifier.lexeme);
+            compiled.undefined = at("Undefined variable: '" + string(identifier.lexeme) + "'", identifier);
+            uint32_t slot = compiled.slot;
+            Message undefined = compiled.undefined;
+            compiled.eval = [slot, undefined](Frame& frame) { return load(frame, slot, undefined); };
+            return compiled;
+        }
+        if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+            return constantValue(constant->getValue());
+        }
+        if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+            SymbolRegistry noSymbols;
+            try {
+                return constantValue(number->eval(noSymbols));
+            } catch (const std::exception& thrown) {
+                return failure(thrown.what());
+            }
+        }
+        if (dynamic_cast<const LiteralExpr*>(e)) {
+            return failure("Invalid literal type for evaluation");
+        }
+        throw std::runtime_error("Cannot compile expression: " + e->toString());
+    }
+
+    static Compiled constantValue(float value)
+    {
+        Compiled compiled;
+        compiled.shape = Compiled::Shape::Constant;
+        compiled.value = value;
+        compiled.eval = [value](Frame&) { return value; };
+        return compiled;
+    }
+
+    static Compiled failure(std::string what)
+    {
+        Compiled compiled;
+        Message error = std::make_shared<const std::string>(std::move(what));
+        compiled.eval = [error](Frame&) -> float { throw std::runtime_error(*error); };
+        return compiled;
+    }
+
+    // `op` applied to `left` and `right`, which are evaluated in that order.
+    // Variable and constant operands are read in place rather than called.
+    template <typename Op>
+    static Compiled combine(Op op, const Compiled& left, const Compiled& right)
+    {
+        using Shape = Compiled::Shape;
+        Compiled compiled;
+        uint32_t leftSlot = left.slot, rightSlot = right.slot;
+        float leftValue = left.value, rightValue = right.value;
+        Message leftUndefined = left.undefined, rightUndefined = right.undefined;
+        if (left.shape == Shape::Variable && right.shape == Shape::Constant) {
+            compiled.eval = [op, leftSlot, leftUndefined, rightValue](Frame& frame) {
+                return op(load(frame, leftSlot, leftUndefined), rightValue);
+            };
+        } else if (left.shape == Shape::Variable && right.shape == Shape::Variable) {
+            compiled.eval = [op, leftSlot, leftUndefined, rightSlot, rightUndefined](Frame& frame) {
+                float leftOperand = load(frame, leftSlot, leftUndefined);
+                return op(leftOperand, load(frame, rightSlot, rightUndefined));
+            };
+        } else if (left.shape == Shape::Constant && right.shape == Shape::Variable) {
+            compiled.eval = [op, leftValue, rightSlot, rightUndefined](Frame& frame) {
+                return op(leftValue, load(frame, rightSlot, rightUndefined));
+            };
+        } else if (right.shape == Shape::Constant) {
+            Eval leftEval = left.eval;
+            compiled.eval = [op, leftEval, rightValue](Frame& frame) { return op(leftEval(frame), rightValue); };
+        } else {
+            Eval leftEval = left.eval, rightEval = right.eval;
+            compiled.eval = [op, leftEval, rightEval](Frame& frame) {
+                float leftOperand = leftEval(frame);
+                return op(leftOperand, rightEval(frame));
+            };
+        }
+        return compiled;
+    }
+};
+
+ClosureProgram ClosureProgram::compile(const std::vector<Statement*>& statements, SymbolRegistry& symbols)
+{
+    ClosureProgram program;
+    program.body = ClosureCompiler(symbols).statements(statements);
+    program.variables = static_cast<uint32_t>(symbols.size());
+    return program;
+}
+
+void ClosureProgram::execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const
+{
+    std::vector<float> values(variables);
+    std::vector<uint8_t> defined(variables);
+    for (uint32_t slot = 0; slot < variables; slot++) {
+        if (symbols.isDefined(slot)) {
+            values[slot] = symbols.get(slot);
+            defined[slot] = 1;
+        }
+    }
+
+    // Variables go back to the registry however the program ends.
+    auto store = [&] {
+        for (uint32_t slot = 0; slot < variables; slot++) {
+            if (defined[slot]) {
+                symbols.set(slot, values[slot]);
+            }
+        }
+    };
+
+    Frame frame { values.data(), defined.data(), input, output };
+    try {
+        body(frame);
+    } catch (...) {
+        store();
+        throw;
+    }
+    store();
+}
@@ -0,0 +1,460 @@
+#include "flatAst.h"
+#include "expr.h"
+#include "outputSink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+static_assert(sizeof(FlatProgram::Node) == 16, "flat nodes are meant to pack into 16 bytes");
+
+class FlatProgramBuilder {
+public:
+    FlatProgram program;
+
+    uint32_t statement(const Statement* stmt)
+    {
+        if (stmt == nullptr) {
+            return FlatProgram::NONE;
+        }
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            uint32_t value = expr(assignment->getExpression());
+            return add(FlatProgram::Kind::Assignment, assignment->getIdentifier(), intern(assignment->getIdentifier().lexeme), value);
+        }
+        if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            uint32_t condition = expr(ifStmt->getCondition());
+            std::vector<uint32_t> thenItems = items(ifStmt->getThenBranch());
+            std::vector<uint32_t> elseItems = items(ifStmt->getElseBranch());
+            uint32_t thenList = list(thenItems);
+            list(elseItems);
+            return add(FlatProgram::Kind::If, nullptr, condition, thenList);
+        }
+        if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            uint32_t body = statements(repeat->getBody());
+            uint32_t condition = expr(repeat->getCondition());
+            return add(FlatProgram::Kind::Repeat, nullptr, condition, body);
+        }
+        if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+            std::vector<uint32_t> operands;
+            for (const Expr* operand : write->getOperands()) {
+                operands.push_back(expr(operand));
+            }
+            return add(FlatProgram::Kind::Write, nullptr, 0, list(operands));
+        }
+        if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            std::vector<uint32_t> targets;
+            for (const Token& identifier : read->getIdentifiers()) {
+                targets.push_back(add(FlatProgram::Kind::Variable, identifier, intern(identifier.lexeme)));
+            }
+            return add(FlatProgram::Kind::Read, nullptr, 0, list(targets));
+        }
+        throw std::runtime_error("Cannot flatten statement: " + stmt->toString());
+    }
+
+    std::vector<uint32_t> items(const ArenaList<Statement*>& stmts)
+    {
+        std::vector<uint32_t> result;
+        for (const Statement* stmt : stmts) {
+            result.push_back(statement(stmt));
+        }
+        return result;
+    }
+
+    uint32_t statements(const ArenaList<Statement*>& stmts)
+    {
+        return list(items(stmts));
+    }
+
+    uint32_t list(const std::vector<uint32_t>& items)
+    {
+        uint32_t start = static_cast<uint32_t>(program.lists.size());
+        program.lists.push_back(static_cast<uint32_t>(items.size()));
+        program.lists.insert(program.lists.end(), items.begin(), items.end());
+        return start;
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> interned;
+
+    uint32_t expr(const Expr* e)
+    {
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            uint32_t left = expr(binary->getLeft());
+            uint32_t right = expr(binary->getRight());
+            uint32_t index = add(FlatProgram::Kind::Binary, binary->getOperator(), left, right);
+            program.nodes[index].op = static_cast<uint64_t>(binary->getOperator().type);
+            return index;
+        }
+        if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            return add(FlatProgram::Kind::Grouping, nullptr, expr(grouping->getExpression()));
+        }
+        if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+            const Token& token = number->getToken();
+            uint32_t index = add(FlatProgram::Kind::Number, token, intern(token.lexeme));
+            // Decode once; if stof() would throw, leave it to execute() to
+            // raise the same error.
+            std::string digits(token.lexeme);
+            errno = 0;
+            char* end = nullptr;
+            float value = std::strtof(digits.c_str(), &end);
+            if (errno != ERANGE && end != digits.c_str()) {
+                std::memcpy(&program.nodes[index].b, &value, sizeof(value));
+                program.nodes[index].op = static_cast<uint64_t>(Token::Type::NUMBER);
+            }
+            return index;
+        }
+        if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+            uint32_t index = add(FlatProgram::Kind::Constant, nullptr);
+            float value = constant->getValue();
+            std::memcpy(&program.nodes[index].b, &value, sizeof(value));
+            return index;
+        }
+        if (auto literal = dynamic_cast<const LiteralExpr*>(e)) {
+            return add(FlatProgram::Kind::Literal, literal->getToken(), intern(literal->getToken().lexeme));
+        }
+        if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            return add(FlatProgram::Kind::Variable, variable->getIdentifier(), intern(variable->getIdentifier().lexeme));
+        }
+        throw std::runtime_error("Cannot flatten expression: " + e->toString());
+    }
+
+    uint32_t add(FlatProgram::Kind kind, const Token& at, uint32_t a = 0, uint32_t b = 0)
+    {
+        return add(kind, &at, a, b);
+    }
+
+    uint32_t add(FlatProgram::Kind kind, const Token* at, uint32_t a = 0, uint32_t b = 0)
+    {
+        FlatProgram::Node node {};
+        node.kind = static_cast<uint64_t>(kind);
+        node.op = static_cast<uint64_t>(Token::Type::ENDOFFILE);
+        node.a = a;
+        node.b = b;
+        if (at) {
+            node.line = std::min<uint32_t>(at->start_line, FlatProgram::MAX_POSITION);
+            node.column = std::min<uint32_t>(at->start_column, FlatProgram::MAX_POSITION);
+        }
+        program.nodes.push_back(node);
+        return static_cast<uint32_t>(program.nodes.size() - 1);
+    }
+
+    uint32_t intern(std::string_view text)
+    {
+        auto it = interned.find(std::string(text));
+        if (it != interned.end()) {
+            return it->second;
+        }
+        uint32_t index = static_cast<uint32_t>(program.stringOffsets.size() - 1);
+        program.stringData += text;
+        program.stringOffsets.push_back(static_cast<uint32_t>(program.stringData.size()));
+        interned.emplace(std::string(text), index);
+        return index;
+    }
+};
+
+FlatProgram FlatProgram::flatten(const std::vector<Statement*>& statements)
+{
+    FlatProgramBuilder builder;
+    std::vector<uint32_t> top;
+    for (const Statement* stmt : statements) {
+        top.push_back(builder.statement(stmt));
+    }
+    builder.program.root = builder.list(top);
+    return std::move(builder.program);
+}
+
+std::string_view FlatProgram::text(uint32_t index) const
+{
+    return std::string_view(stringData).substr(stringOffsets[index], stringOffsets[index + 1] - stringOffsets[index]);
+}
+
+size_t FlatProgram::bytesUsed() const
+{
+    return nodes.size() * sizeof(Node) + lists.size() * sizeof(uint32_t)
+        + stringOffsets.size() * sizeof(uint32_t) + stringData.size();
+}
+
+Token FlatProgram::token(const Node& node, Token::Type type, std::string_view lexeme) const
+{
+    int line = static_cast<int>(node.line);
+    int column = static_cast<int>(node.column);
+    int length = static_cast<int>(lexeme.size()) + (type == Token::Type::LITERAL ? 2 : 0);
+    return Token(type, lexeme, line, column, line, column + length);
+}
+
+std::vector<Statement*> FlatProgram::toStatements(Arena& arena) const
+{
+    struct Rebuilder {
+        const FlatProgram& program;
+        Arena& arena;
+
+        std::vector<Statement*> statements(uint32_t list)
+        {
+            std::vector<Statement*> result;
+            uint32_t count = program.lists[list];
+            for (uint32_t i = 1; i <= count; i++) {
+                result.push_back(statement(program.lists[list + i]));
+            }
+            return result;
+        }
+
+        ArenaList<Statement*> statementList(uint32_t list)
+        {
+            return ArenaList<Statement*>(arena, statements(list));
+        }
+
+        Statement* statement(uint32_t index)
+        {
+            if (index == FlatProgram::NONE) {
+                return nullptr;
+            }
+            const Node& node = program.nodes[index];
+            switch (static_cast<Kind>(node.kind)) {
+            case Kind::Assignment:
+                return arena.make<AssignmentStatement>(program.token(node, Token::Type::IDENTIFIER, program.text(node.a)), expr(node.b));
+            case Kind::If: {
+                Expr* condition = expr(node.a);
+                ArenaList<Statement*> thenBranch = statementList(node.b);
+                return arena.make<IfStatement>(condition, thenBranch, statementList(program.elseList(node)));
+            }
+            case Kind::Repeat: {
+                ArenaList<Statement*> body = statementList(node.b);
+                return arena.make<RepeatStatement>(body, expr(node.a));
+            }
+            case Kind::Write: {
+                std::vector<Expr*> operands;
+                for (uint32_t i = 1; i <= program.lists[node.b]; i++) {
+                    operands.push_back(expr(program.lists[node.b + i]));
+                }
+                return arena.make<WriteStatement>(ArenaList<Expr*>(arena, operands));
+            }
+            case Kind::Read: {
+                std::vector<Token> identifiers;
+                for (uint32_t i = 1; i <= program.lists[node.b]; i++) {
+                    const Node& target = program.nodes[program.lists[node.b + i]];
+                    identifiers.push_back(program.token(target, Token::Type::IDENTIFIER, program.text(target.a)));
+                }
+                return arena.make<ReadStatement>(ArenaList<Token>(arena, identifiers));
+            }
+            default:
+                throw std::runtime_error("Corrupt flat program: expression where a statement was expected");
+            }
+        }
+
+        Expr* expr(uint32_t index)
+        {
+            const Node& node = program.nodes[index];
+            switch (static_cast<Kind>(node.kind)) {
+            case Kind::Binary: {
+                Expr* left = expr(node.a);
+                Expr* right = expr(node.b);
+                Token::Type op = static_cast<Token::Type>(node.op);
+                return makeBinaryExpr(arena, left, program.token(node, op, Token::getSpelling(op)), right);
+            }
+            case Kind::Grouping:
+                return arena.make<GroupingExpression>(expr(node.a));
+            case Kind::Number:
+                return arena.make<NumberExpr>(program.token(node, Token::Type::NUMBER, program.text(node.a)));
+            case Kind::Literal:
+                return arena.make<LiteralExpr>(program.token(node, Token::Type::LITERAL, program.text(node.a)));
+            case Kind::Variable:
+                return arena.make<VariableExpr>(program.token(node, Token::Type::IDENTIFIER, program.text(node.a)));
+            case Kind::Constant: {
+                float value;
+                std::memcpy(&value, &node.b, sizeof(value));
+                return arena.make<ConstantExpr>(value);
+            }
+            default:
+                throw std::runtime_error("Corrupt flat program: statement where an expression was expected");
+            }
+        }
+    };
+
+    Rebuilder rebuilder { *this, arena };
+    return rebuilder.statements(root);
+}
+
+bool FlatProgram::isWellFormed() const
+{
+    if (stringOffsets.empty() || stringOffsets.front() != 0 || stringOffsets.back() != stringData.size()
+        || !std::is_sorted(stringOffsets.begin(), stringOffsets.end())) {
+        return false;
+    }
+    uint32_t stringCount = static_cast<uint32_t>(stringOffsets.size() - 1);
+
+    auto isExpression = [&](uint32_t index) { return static_cast<Kind>(nodes[index].kind) <= Kind::Constant; };
+    auto expression = [&](uint32_t index, uint32_t parent) { return index < parent && isExpression(index); };
+    // A list of statements (or expressions) that all come before `parent`.
+    auto list = [&](uint32_t index, uint32_t parent, bool ofStatements) {
+        if (index >= lists.size() || lists[index] > lists.size() - index - 1) {
+            return false;
+        }
+        for (uint32_t i = 1; i <= lists[index]; i++) {
+            uint32_t item = lists[index + i];
+            if (item == NONE && ofStatements) {
+                continue;
+            }
+            if (item >= parent || isExpression(item) == ofStatements) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        const Node& node = nodes[i];
+        bool valid = false;
+        switch (static_cast<Kind>(node.kind)) {
+        case Kind::Binary:
+            valid = expression(node.a, i) && expression(node.b, i) && node.op <= static_cast<uint32_t>(Token::Type::ENDOFFILE);
+            break;
+        case Kind::Grouping:
+            valid = expression(node.a, i);
+            break;
+        case Kind::Number:
+        case Kind::Literal:
+        case Kind::Variable:
+            valid = node.a < stringCount;
+            break;
+        case Kind::Constant:
+            valid = true;
+            break;
+        case Kind::Assignment:
+            valid = node.a < stringCount && expression(node.b, i);
+            break;
+        case Kind::If:
+            valid = expression(node.a, i) && list(node.b, i, true) && list(elseList(node), i, true);
+            break;
+        case Kind::Repeat:
+            valid = expression(node.a, i) && list(node.b, i, true);
+            break;
+        case Kind::Write:
+            valid = list(node.b, i, false);
+            break;
+        case Kind::Read:
+            valid = list(node.b, i, false);
+            for (uint32_t j = 1; valid && j <= lists[node.b]; j++) {
+                valid = static_cast<Kind>(nodes[lists[node.b + j]].kind) == Kind::Variable;
+            }
+            break;
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+    return list(root, static_cast<uint32_t>(nodes.size()), true);
+}
+
+void FlatProgram::execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const
+{
+    Frame frame { symbols, std::vector<uint32_t>(stringOffsets.size() - 1, SymbolRegistry::NO_SLOT), input, output };
+    for (const Node& node : nodes) {
+        Kind kind = static_cast<Kind>(node.kind);
+        if ((kind == Kind::Variable || kind == Kind::Assignment) && frame.slots[node.a] == SymbolRegistry::NO_SLOT) {
+            frame.slots[node.a] = symbols.slot(text(node.a));
+        }
+    }
+    run(root, frame);
+}
+
+float FlatProgram::eval(uint32_t index, Frame& frame) const
+{
+    const Node& node = nodes[index];
+    switch (static_cast<Kind>(node.kind)) {
+    case Kind::Binary: {
+        float leftValue = eval(node.a, frame);
+        float rightValue = eval(node.b, frame);
+        switch (static_cast<Token::Type>(node.op)) {
+        case Token::Type::PLUS: return leftValue + rightValue;
+        case Token::Type::MINUS: return leftValue - rightValue;
+        case Token::Type::MULTIPLY: return leftValue * rightValue;
+        case Token::Type::DIVIDE:
+            if (rightValue == 0) {
+                throw std::runtime_error("Division by zero at operator '/' at line " + std::to_string(node.line) + ", column " + std::to_string(node.column));
+            }
+            return leftValue / rightValue;
+        case Token::Type::LESS_THAN: return leftValue < rightValue ? 1 : 0;
+        case Token::Type::LESS_EQUAL: return leftValue <= rightValue ? 1 : 0;
+        case Token::Type::GREATER_THAN: return leftValue > rightValue ? 1 : 0;
+        case Token::Type::GREATER_EQUAL: return leftValue >= rightValue ? 1 : 0;
+        case Token::Type::EQUAL: return leftValue == rightValue ? 1 : 0;
+        case Token::Type::NOT_EQUAL: return leftValue != rightValue ? 1 : 0;
+        default:
+            throw std::runtime_error("Unknown operator: '" + std::string(Token::getSpelling(static_cast<Token::Type>(node.op))) + "' at line " + std::to_string(node.line) + ", column " + std::to_string(node.column));
+        }
+    }
+    case Kind::Grouping:
+        return eval(node.a, frame);
+    case Kind::Number:
+        if (static_cast<Token::Type>(node.op) == Token::Type::NUMBER) {
+            float value;
+            std::memcpy(&value, &node.b, sizeof(value));
+            return value;
+        }
+        return std::stof(std::string(text(node.a)));
+    case Kind::Constant: {
+        float value;
+        std::memcpy(&value, &node.b, sizeof(value));
+        return value;
+    }
+    case Kind::Literal:
+        throw std::runtime_error("Invalid literal type for evaluation");
+    case Kind::Variable:
+        try {
+            return frame.symbols.get(frame.slots[node.a]);
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error("Undefined variable: '" + std::string(text(node.a)) + "' at line " + std::to_string(node.line) + ", column " + std::to_string(node.column));
+        }
+    default:
+        throw std::runtime_error("Corrupt flat program: statement where an expression was expected");
+    }
+}
+
+void FlatProgram::run(uint32_t list, Frame& frame) const
+{
+    uint32_t count = lists[list];
+    for (uint32_t i = 1; i <= count; i++) {
+        if (lists[list + i] == NONE) {
+            continue;
+        }
+        const Node& node = nodes[lists[list + i]];
+        switch (static_cast<Kind>(node.kind)) {
+        case Kind::Assignment:
+            frame.symbols.set(frame.slots[node.a], eval(node.b, frame));
+            break;
+        case Kind::If:
+            if (eval(node.a, frame)) {
+                run(node.b, frame);
+            } else {
+                run(elseList(node), frame);
+            }
+            break;
+        case Kind::Repeat:
+            do {
+                run(node.b, frame);
+            } while (!eval(node.a, frame));
+            break;
+        case Kind::Write:
+            for (uint32_t j = 1; j <= lists[node.b]; j++) {
+                const Node& operand = nodes[lists[node.b + j]];
+                if (static_cast<Kind>(operand.kind) == Kind::Literal) {
+                    frame.output << text(operand.a);
+                } else {
+                    frame.output << eval(lists[node.b + j], frame);
+                }
+            }
+            endLine(frame.output);
+            break;
+        case Kind::Read:
+            for (uint32_t j = 1; j <= lists[node.b]; j++) {
+                const Node& target = nodes[lists[node.b + j]];
+                frame.symbols.set(std::string(text(target.a)), readInputValue(frame.input, token(target, Token::Type::IDENTIFIER, text(target.a))));
+            }
+            break;
+        default:
+            throw std::runtime_error("Corrupt flat program: expression where a statement was expected");
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator for AST nodes. Nodes are carved out of large blocks one
+// after another, so a tree sits in a few contiguous chunks of memory, and
+// the whole tree goes away at once when the arena is destroyed.
+//
+// Destructors of objects made here are never run. Only types that own no
+// memory of their own may live in an arena; child lists use ArenaList
+// instead of std::vector for that reason.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        size_t offset = (used + alignment - 1) & ~(alignment - 1);
+        if (blocks.empty() || offset + size > blockSize) {
+            newBlock(size + alignment);
+            offset = (used + alignment - 1) & ~(alignment - 1);
+        }
+        used = offset + size;
+        totalUsed += size;
+        return blocks.back().get() + offset;
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    size_t bytesUsed() const { return totalUsed; }
+
+    // Takes over the blocks of `other`, leaving it empty. Objects made in
+    // `other` now live as long as this arena.
+    void adopt(Arena& other)
+    {
+        auto position = blocks.empty() ? blocks.end() : blocks.end() - 1;
+        blocks.insert(position, std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+        totalUsed += other.totalUsed;
+        other.blocks.clear();
+        other.blockSize = 0;
+        other.used = 0;
+        other.totalUsed = 0;
+    }
+
+private:
+    static constexpr size_t FIRST_BLOCK_SIZE = 16 * 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+    void newBlock(size_t minimum)
+    {
+        size_t size = blocks.empty() ? FIRST_BLOCK_SIZE : std::min(blockSize * 2, MAX_BLOCK_SIZE);
+        if (size < minimum) {
+            size = minimum;
+        }
+        blocks.emplace_back(new char[size]);
+        blockSize = size;
+        used = 0;
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockSize = 0;
+    size_t used = 0;
+    size_t totalUsed = 0;
+};
+
+// Fixed-size array living in an Arena; what AST nodes use in place of
+// std::vector for their children.
+template <typename T>
+class ArenaList {
+public:
+    ArenaList() = default;
+    ArenaList(Arena& arena, const std::vector<T>& values)
+        : count(values.size())
+    {
+        if (count > 0) {
+            items = static_cast<T*>(arena.allocate(sizeof(T) * count, alignof(T)));
+            for (size_t i = 0; i < count; ++i) {
+                new (items + i) T(values[i]);
+            }
+        }
+    }
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+
+private:
+    T* items = nullptr;
+    size_t count = 0;
+};
+
+#endif // ARENA_H
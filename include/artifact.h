@@ -0,0 +1,61 @@
+#ifndef ARTIFACT_H
+#define ARTIFACT_H
+
+#include "flatAst.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Compiled form of a program on disk (a ".tlc" file): a fixed header, then
+// the arrays of its FlatProgram and the lexer diagnostics its source
+// produced, all in native byte order. Loading one is a few memcpy()s, so a
+// program that has been compiled once skips the Lexer and Parser entirely.
+//
+// The header records the format version, the layout of the host, the hash
+// and size of the source and a checksum of everything after it; load()
+// rejects artifacts where any of those do not match.
+class ProgramArtifact {
+public:
+    // Bump whenever the layout of the file or of FlatProgram changes.
+    static constexpr uint32_t VERSION = 2;
+
+    struct Loaded {
+        FlatProgram program;
+        std::string diagnostics;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+    };
+
+    // 64-bit FNV-1a style hash; keys sources and checksums artifacts.
+    static uint64_t hash(std::string_view bytes);
+    // True if `bytes` starts like an artifact (it may still be invalid).
+    static bool isArtifact(std::string_view bytes);
+
+    // Artifact of `program`, compiled from `source`.
+    static std::string serialize(const FlatProgram& program, std::string_view source, std::string_view diagnostics);
+    // Throws std::runtime_error saying what is wrong with a stale or
+    // corrupt artifact.
+    static Loaded load(std::string_view bytes);
+};
+
+// Directory of artifacts named after the hash of the source they were
+// compiled from, so repeat runs of the same program can skip parsing.
+class ProgramCache {
+public:
+    explicit ProgramCache(std::string directory);
+
+    // Loads the artifact for `source`. Missing, stale and corrupt entries
+    // are all a miss.
+    bool load(std::string_view source, ProgramArtifact::Loaded& loaded) const;
+    // Writes the artifact for `source`, replacing any old one atomically so
+    // concurrent runs never see a partial file. Returns false if it could
+    // not be written.
+    bool store(std::string_view source, const FlatProgram& program, std::string_view diagnostics) const;
+
+    std::string pathFor(std::string_view source) const;
+
+private:
+    std::string directory;
+};
+
+#endif // ARTIFACT_H
@@ -0,0 +1,124 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "statement.h"
+#include "symbolTable.h"
+#include "token.h"
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A program compiled to register bytecode, and the VM that runs it.
+//
+// Every value lives in one flat register file: first one register per
+// variable (its SymbolRegistry slot), then one per distinct constant, then
+// the temporaries expressions need. Instructions name their registers
+// directly, so `x := x + 1` is a single ADD and the VM never calls through
+// a node or dispatches on an operator token; it is one switch over a dense
+// opcode in a loop.
+//
+// A program is compiled against the registry it will run with: the compiler
+// binds variables to its slots, and tracks which variables are certainly
+// assigned at each read so only the others pay for an "undefined variable"
+// check. Output and errors (including their text and positions) are the
+// same as Statement::execute().
+//
+// Compiled with `integers`, variables and expressions that TypeInference
+// proves integer-only run on a second, int64_t register file with their own
+// opcodes; the rest, such as division results, stay float and integers are
+// converted where they meet. This is an opt-in dialect, not an
+// optimization: integers are exact up to 2^63 instead of 2^24 and print in
+// full rather than as "%g" does. Where int64_t cannot give the float
+// result (a +, - or * that overflows, a product that float makes -0, or a
+// read of -0 or of more than int64_t holds) the program goes on as the
+// float program compiled from the same statements, from the start of the
+// assignment, condition, write operand or read that got there.
+class BytecodeProgram {
+public:
+    enum class Op : uint8_t {
+        Add, // a = b + c
+        Subtract,
+        Multiply,
+        Divide, // site = division by zero message
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        Move, // a = b
+        Check, // throws message `site` unless a is defined
+        Define, // marks a defined
+        Jump, // to a
+        JumpIfZero, // to a if b == 0
+        WriteValue, // b
+        WriteText, // texts[site]
+        WriteEnd,
+        Read, // a = next input value for reads[site]
+        Fail, // throws message `site`
+        Halt,
+        // The same on the integer registers. Arithmetic that int64_t cannot
+        // do the float way goes on in the fallback from unit `site`.
+        AddInt,
+        SubtractInt,
+        MultiplyInt,
+        LessInt,
+        LessEqualInt,
+        GreaterInt,
+        GreaterEqualInt,
+        EqualInt,
+        NotEqualInt,
+        MoveInt,
+        ToFloat, // a = float(integer b)
+        JumpIfZeroInt,
+        WriteInt,
+        ReadInt, // as Read; a value int64_t cannot hold goes on in unit c
+    };
+
+    struct Instruction {
+        uint32_t op : 8; // Op
+        uint32_t site : 24; // index of a message, text, read or unit
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+    };
+
+    static BytecodeProgram compile(const std::vector<Statement*>& statements, SymbolRegistry& symbols, bool integers = false);
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const;
+
+    size_t instructionCount() const { return code.size(); }
+    size_t registerCount() const { return registers; }
+    // One instruction per line, for debugging the compiler.
+    std::string disassemble() const;
+
+private:
+    friend class BytecodeCompiler;
+
+    std::vector<Instruction> code;
+    // Number of variable registers; they come first.
+    uint32_t variables = 0;
+    uint32_t registers = 0;
+    // Initial values of the constant registers, from register `variables`.
+    std::vector<float> constants;
+    // Their values on the integer registers (0 for float constants).
+    std::vector<int64_t> integerConstants;
+    // Which variables are on the integer registers.
+    std::vector<uint8_t> integerVariables;
+    std::vector<std::string> messages;
+    std::vector<std::string> texts;
+    std::vector<Token> reads;
+    // Where each assignment, condition, write operand and read starts; the
+    // same units in the same order for both register files.
+    std::vector<uint32_t> units;
+    // The float program the integer one goes on in.
+    std::shared_ptr<const BytecodeProgram> fallback;
+
+    void run(std::vector<float>& file, std::vector<int64_t>& integerFile, std::vector<uint8_t>& defined, size_t from,
+        SymbolRegistry& symbols, std::istream& input, std::ostream& output) const;
+};
+
+#endif // BYTECODE_H
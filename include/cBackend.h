@@ -0,0 +1,28 @@
+#ifndef CBACKEND_H
+#define CBACKEND_H
+
+#include "statement.h"
+#include <string>
+#include <vector>
+
+// Ahead-of-time backend: translates a parsed program into one portable C99
+// file with a main() that runs it.
+//
+// Variables become float locals, `repeat` a do/while and `if` an if, and
+// write/read go through buffered stdio. Every value is computed in float
+// with the same operations in the same order as Statement::execute(), and
+// numbers are printed with "%g", which is how std::ostream prints a float,
+// so a program prints exactly what the interpreter would. Runtime errors
+// print the interpreter's message as "Error: ..." on stderr and exit with
+// status 1; output written before the error is kept.
+class CBackend {
+public:
+    static std::string emit(const std::vector<Statement*>& program);
+
+    // Compiles C source `source` into the executable `output` with the
+    // system compiler ($CC, or cc). On failure, returns false with the
+    // reason in `error`.
+    static bool compileNative(const std::string& source, const std::string& output, std::string& error);
+};
+
+#endif // CBACKEND_H
@@ -0,0 +1,46 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "statement.h"
+#include "symbolTable.h"
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// A program compiled to a tree of pre-bound C++ callables: every Expr
+// becomes a function returning its value and every Statement a function
+// running it. The operator, the decoded value of each literal and the slot
+// of each variable are captured when the closure is made, so running it
+// never looks at a Token or dispatches on a node type; the only indirect
+// calls left are the ones from a closure to its children.
+//
+// Like BytecodeProgram, a program is compiled against the registry it runs
+// with, and its output and errors are the same as Statement::execute().
+class ClosureProgram {
+public:
+    // Variables while the program runs, copied in from the registry and
+    // written back when it ends.
+    struct Frame {
+        float* values;
+        uint8_t* defined;
+        std::istream& input;
+        std::ostream& output;
+    };
+
+    using Eval = std::function<float(Frame&)>;
+    using Exec = std::function<void(Frame&)>;
+
+    static ClosureProgram compile(const std::vector<Statement*>& statements, SymbolRegistry& symbols);
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const;
+
+private:
+    friend class ClosureCompiler;
+
+    Exec body;
+    uint32_t variables = 0;
+};
+
+#endif // CLOSURE_H
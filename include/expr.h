@@ -1,10 +1,13 @@
 #ifndef EXPR_H
 #define EXPR_H
 
+#include "arena.h"
 #include "symbolTable.h"
 #include "token.h"
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
 
 using namespace std;
@@ -14,6 +17,12 @@ public:
     virtual ~Expr() = default;
     virtual string toString() const = 0;
     virtual float eval(SymbolRegistry& symbols) const = 0;
+    // Moves the line/column of every token in the subtree; see
+    // Parser::reparse().
+    virtual void shiftPositions(const PositionShift& shift) = 0;
+    // Binds every variable in the subtree to its slot in `symbols`; run
+    // before evaluating against that registry.
+    virtual void resolve(SymbolRegistry& symbols) = 0;
 };
 
 class BinaryExpr : public Expr {
@@ -30,46 +39,67 @@ public:
     {
     }
 
+    Expr* getLeft() const { return left; }
+    Expr* getRight() const { return right; }
+    const Token& getOperator() const { return op; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        left->shiftPositions(shift);
+        shift.apply(op);
+        right->shiftPositions(shift);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        left->resolve(symbols);
+        right->resolve(symbols);
+    }
+
     string toString() const override
     {
-        return "BinaryExpr(" + left->toString() + " " + op.lexeme + " " + right->toString() + ")";
+        return "BinaryExpr(" + left->toString() + " " + string(op.lexeme) + " " + right->toString() + ")";
     }
 
+    // The generic evaluation, dispatching on the operator each time. Nodes
+    // made by makeBinaryExpr() are usually a BinaryOp that overrides it.
     float eval(SymbolRegistry& symbols) const override
     {
         float leftValue = left->eval(symbols);
         float rightValue = right->eval(symbols);
 
-        if (op.type == Token::Type::DIVIDE && rightValue == 0) {
-            throw runtime_error("Division by zero at operator '" + op.lexeme + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column));
-        }
-
-        if (op.type == Token::Type::PLUS)
+        switch (op.type) {
+        case Token::Type::PLUS:
             return leftValue + rightValue;
-        if (op.type == Token::Type::MINUS)
+        case Token::Type::MINUS:
             return leftValue - rightValue;
-        if (op.type == Token::Type::MULTIPLY)
+        case Token::Type::MULTIPLY:
             return leftValue * rightValue;
-        if (op.type == Token::Type::DIVIDE) {
+        case Token::Type::DIVIDE:
             if (rightValue == 0) {
-                throw runtime_error("Division by zero");
+                throwDivisionByZero(op);
             }
             return leftValue / rightValue;
-        }
-        if (op.type == Token::Type::LESS_THAN)
+        case Token::Type::LESS_THAN:
             return leftValue < rightValue ? 1 : 0;
-        if (op.type == Token::Type::LESS_EQUAL)
+        case Token::Type::LESS_EQUAL:
             return leftValue <= rightValue ? 1 : 0;
-        if (op.type == Token::Type::GREATER_THAN)
+        case Token::Type::GREATER_THAN:
             return leftValue > rightValue ? 1 : 0;
-        if (op.type == Token::Type::GREATER_EQUAL)
+        case Token::Type::GREATER_EQUAL:
             return leftValue >= rightValue ? 1 : 0;
-        if (op.type == Token::Type::EQUAL)
+        case Token::Type::EQUAL:
             return leftValue == rightValue ? 1 : 0;
-        if (op.type == Token::Type::NOT_EQUAL)
+        case Token::Type::NOT_EQUAL:
             return leftValue != rightValue ? 1 : 0;
+        default:
+            throw runtime_error("Unknown operator: '" + string(op.lexeme) + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column));
+        }
+    }
 
-        throw runtime_error("Unknown operator: '" + op.lexeme + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column));
+    [[noreturn]] static void throwDivisionByZero(const Token& op)
+    {
+        throw runtime_error("Division by zero at operator '" + string(op.lexeme) + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column));
     }
 };
 
@@ -84,6 +114,18 @@ public:
     {
     }
 
+    Expr* getExpression() const { return expression; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        expression->shiftPositions(shift);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        expression->resolve(symbols);
+    }
+
     string toString() const override
     {
         return "GroupingExpression(" + expression->toString() + ")";
@@ -105,17 +147,76 @@ public:
     {
     }
 
+    const Token& getToken() const { return token; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        shift.apply(token);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+    }
+
     string toString() const override
     {
-        return "NumberExpr(" + token.lexeme + ")";
+        return "NumberExpr(" + string(token.lexeme) + ")";
     }
 
     float eval(SymbolRegistry& symbols) const override
     {
         if (token.type == Token::Type::NUMBER) {
-            return stof(token.lexeme);
+            return stof(string(token.lexeme));
         }
-        throw runtime_error("Invalid literal type for evaluation: '" + token.lexeme + "' at line " + to_string(token.start_line) + ", column " + to_string(token.start_column));
+        throw runtime_error("Invalid literal type for evaluation: '" + string(token.lexeme) + "' at line " + to_string(token.start_line) + ", column " + to_string(token.start_column));
+    }
+};
+
+// A number known before the program runs: a decoded literal or a folded
+// constant subexpression. Only the Optimizer makes these. One that stands
+// for an integer also keeps it exactly, for the int64 path (see
+// TypeInference), since the float may have rounded it.
+class ConstantExpr : public Expr {
+private:
+    float value;
+    int64_t integer = 0;
+    bool hasInteger = false;
+
+public:
+    explicit ConstantExpr(float value)
+        : value(value)
+    {
+    }
+
+    ConstantExpr(float value, int64_t integer)
+        : value(value)
+        , integer(integer)
+        , hasInteger(true)
+    {
+    }
+
+    float getValue() const { return value; }
+    bool isInteger() const { return hasInteger; }
+    int64_t getInteger() const { return integer; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+    }
+
+    string toString() const override
+    {
+        ostringstream text;
+        text << value;
+        return "ConstantExpr(" + text.str() + ")";
+    }
+
+    float eval(SymbolRegistry& symbols) const override
+    {
+        return value;
     }
 };
 
@@ -130,9 +231,20 @@ public:
     {
     }
 
+    const Token& getToken() const { return token; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        shift.apply(token);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+    }
+
     string toString() const override
     {
-        return "LiteralExpr(\"" + token.lexeme + "\")";
+        return "LiteralExpr(\"" + string(token.lexeme) + "\")";
     }
 
     float eval(SymbolRegistry& symbols) const override
@@ -142,7 +254,7 @@ public:
 
     string getValue() const
     {
-        return token.lexeme;
+        return string(token.lexeme);
     }
 };
 
@@ -150,6 +262,7 @@ public:
 class VariableExpr : public Expr {
 private:
     Token identifier;
+    uint32_t slot = SymbolRegistry::NO_SLOT;
 
 public:
     VariableExpr(const Token& identifier)
@@ -157,19 +270,171 @@ public:
     {
     }
 
+    const Token& getIdentifier() const { return identifier; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        shift.apply(identifier);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        slot = symbols.slot(identifier.lexeme);
+    }
+
     string toString() const override
     {
-        return "VariableExpr(" + identifier.lexeme + ")";
+        return "VariableExpr(" + string(identifier.lexeme) + ")";
     }
 
     float eval(SymbolRegistry& symbols) const override
     {
         try {
-            return symbols.get(identifier.lexeme);
+            return slot != SymbolRegistry::NO_SLOT ? symbols.get(slot) : symbols.get(string(identifier.lexeme));
         } catch (const std::runtime_error& e) {
-            throw runtime_error("Undefined variable: '" + identifier.lexeme + "' at line " + to_string(identifier.start_line) + ", column " + to_string(identifier.start_column));
+            throw runtime_error("Undefined variable: '" + string(identifier.lexeme) + "' at line " + to_string(identifier.start_line) + ", column " + to_string(identifier.start_column));
         }
     }
 };
 
+// The operators of BinaryOp; each applies one operator, as BinaryExpr::eval()
+// does for its token.
+namespace BinaryOps {
+struct Plus {
+    static float apply(float left, float right, const Token&) { return left + right; }
+};
+struct Minus {
+    static float apply(float left, float right, const Token&) { return left - right; }
+};
+struct Multiply {
+    static float apply(float left, float right, const Token&) { return left * right; }
+};
+struct Divide {
+    static float apply(float left, float right, const Token& op)
+    {
+        if (right == 0) {
+            BinaryExpr::throwDivisionByZero(op);
+        }
+        return left / right;
+    }
+};
+struct Less {
+    static float apply(float left, float right, const Token&) { return left < right ? 1 : 0; }
+};
+struct LessEqual {
+    static float apply(float left, float right, const Token&) { return left <= right ? 1 : 0; }
+};
+struct Greater {
+    static float apply(float left, float right, const Token&) { return left > right ? 1 : 0; }
+};
+struct GreaterEqual {
+    static float apply(float left, float right, const Token&) { return left >= right ? 1 : 0; }
+};
+struct Equal {
+    static float apply(float left, float right, const Token&) { return left == right ? 1 : 0; }
+};
+struct NotEqual {
+    static float apply(float left, float right, const Token&) { return left != right ? 1 : 0; }
+};
+} // namespace BinaryOps
+
+// The shapes of operands BinaryOp specializes on. A constant is a
+// ConstantExpr or a NumberExpr whose value is decoded once when the node is
+// made; a variable is read without a virtual call.
+enum class OperandShape {
+    Any, // both operands evaluated through Expr::eval()
+    VariableConstant, // x op 3
+    ConstantVariable, // 3 op x
+};
+
+// A BinaryExpr specialized at compile time on its operator and the shape of
+// its operands, so eval() is the one operation with no dispatch on the
+// token. It is still a BinaryExpr, with the same children, token and
+// printed form, for everything that inspects the tree.
+template <typename Op, OperandShape Shape>
+class BinaryOp final : public BinaryExpr {
+private:
+    // The value of the constant operand, if there is one.
+    float constant;
+
+public:
+    BinaryOp(Expr* left, Token op, Expr* right, float constant = 0)
+        : BinaryExpr(left, op, right)
+        , constant(constant)
+    {
+    }
+
+    float eval(SymbolRegistry& symbols) const override
+    {
+        if (Shape == OperandShape::VariableConstant) {
+            float leftValue = static_cast<const VariableExpr*>(getLeft())->VariableExpr::eval(symbols);
+            return Op::apply(leftValue, constant, getOperator());
+        }
+        if (Shape == OperandShape::ConstantVariable) {
+            float rightValue = static_cast<const VariableExpr*>(getRight())->VariableExpr::eval(symbols);
+            return Op::apply(constant, rightValue, getOperator());
+        }
+        float leftValue = getLeft()->eval(symbols);
+        float rightValue = getRight()->eval(symbols);
+        return Op::apply(leftValue, rightValue, getOperator());
+    }
+};
+
+namespace BinaryOps {
+
+// Whether `e` is a constant with a value known now, and that value.
+inline bool constantValue(const Expr* e, float& value)
+{
+    if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+        value = constant->getValue();
+        return true;
+    }
+    auto number = dynamic_cast<const NumberExpr*>(e);
+    if (!number || number->getToken().type != Token::Type::NUMBER) {
+        return false;
+    }
+    // A literal stof() rejects keeps failing when evaluated.
+    try {
+        value = stof(string(number->getToken().lexeme));
+        return true;
+    } catch (const std::logic_error&) {
+        return false;
+    }
+}
+
+template <typename Op>
+BinaryExpr* make(Arena& arena, Expr* left, const Token& op, Expr* right)
+{
+    float value;
+    if (dynamic_cast<const VariableExpr*>(left) && constantValue(right, value)) {
+        return arena.make<BinaryOp<Op, OperandShape::VariableConstant>>(left, op, right, value);
+    }
+    if (constantValue(left, value) && dynamic_cast<const VariableExpr*>(right)) {
+        return arena.make<BinaryOp<Op, OperandShape::ConstantVariable>>(left, op, right, value);
+    }
+    return arena.make<BinaryOp<Op, OperandShape::Any>>(left, op, right);
+}
+
+} // namespace BinaryOps
+
+// A BinaryExpr for `left op right`, specialized on the operator and operand
+// shapes when there is a BinaryOp for them. Parser and passes that build
+// expressions make them here.
+inline BinaryExpr* makeBinaryExpr(Arena& arena, Expr* left, const Token& op, Expr* right)
+{
+    switch (op.type) {
+    case Token::Type::PLUS: return BinaryOps::make<BinaryOps::Plus>(arena, left, op, right);
+    case Token::Type::MINUS: return BinaryOps::make<BinaryOps::Minus>(arena, left, op, right);
+    case Token::Type::MULTIPLY: return BinaryOps::make<BinaryOps::Multiply>(arena, left, op, right);
+    case Token::Type::DIVIDE: return BinaryOps::make<BinaryOps::Divide>(arena, left, op, right);
+    case Token::Type::LESS_THAN: return BinaryOps::make<BinaryOps::Less>(arena, left, op, right);
+    case Token::Type::LESS_EQUAL: return BinaryOps::make<BinaryOps::LessEqual>(arena, left, op, right);
+    case Token::Type::GREATER_THAN: return BinaryOps::make<BinaryOps::Greater>(arena, left, op, right);
+    case Token::Type::GREATER_EQUAL: return BinaryOps::make<BinaryOps::GreaterEqual>(arena, left, op, right);
+    case Token::Type::EQUAL: return BinaryOps::make<BinaryOps::Equal>(arena, left, op, right);
+    case Token::Type::NOT_EQUAL: return BinaryOps::make<BinaryOps::NotEqual>(arena, left, op, right);
+    default: return arena.make<BinaryExpr>(left, op, right);
+    }
+}
+
 #endif // EXPR_H
\ No newline at end of file
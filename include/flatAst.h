@@ -0,0 +1,103 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include "arena.h"
+#include "statement.h"
+#include "symbolTable.h"
+#include "token.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Flat, index-based encoding of a parsed program.
+//
+// Every node is a fixed 16-byte record in one contiguous array: kind,
+// operator and position are bit-packed into one word, children are 32-bit
+// indices into the array, child lists live in a shared index array and
+// identifier/literal text is interned once into a string pool. A BinaryExpr
+// alone is 64 bytes, so this is several times smaller than the pointer tree,
+// and it is walked front to back.
+//
+// flatten() and toStatements() convert from and to the node classes in
+// expr.h/statement.h, so existing consumers keep working; execute() runs the
+// flat form directly with the same semantics and error messages as
+// Statement::execute().
+class FlatProgram {
+public:
+    enum class Kind : uint8_t {
+        Binary, // a = left, b = right, op = operator
+        Grouping, // a = inner expression
+        Number, // a = string (digits), b = value bits if op == NUMBER
+        Literal, // a = string (contents)
+        Variable, // a = string (name)
+        Constant, // b = value bits (a ConstantExpr)
+        Assignment, // a = string (name), b = expression
+        If, // a = condition, b = then list; the else list follows it
+        Repeat, // a = condition, b = body list
+        Write, // b = operand list
+        Read, // b = list of Variable nodes
+    };
+
+    // Index meaning "no node": statements that failed to parse.
+    static constexpr uint32_t NONE = UINT32_MAX;
+    // Positions past this saturate.
+    static constexpr uint32_t MAX_POSITION = (1u << 24) - 1;
+
+    struct Node {
+        uint64_t kind : 8; // Kind
+        uint64_t op : 8; // Token::Type
+        // Start of the token that errors are reported at.
+        uint64_t line : 24;
+        uint64_t column : 24;
+        uint32_t a;
+        uint32_t b;
+    };
+
+    static FlatProgram flatten(const std::vector<Statement*>& statements);
+    // Rebuilds node objects in `arena`. Their tokens view this program's
+    // string pool, so it has to outlive them.
+    std::vector<Statement*> toStatements(Arena& arena) const;
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t bytesUsed() const;
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+    // A list is stored as its length followed by the element indices.
+    const std::vector<uint32_t>& getLists() const { return lists; }
+    uint32_t elseList(const Node& ifNode) const { return ifNode.b + 1 + lists[ifNode.b]; }
+    uint32_t getRoot() const { return root; }
+    std::string_view text(uint32_t index) const;
+
+private:
+    friend class FlatProgramBuilder;
+    friend class ProgramArtifact;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> lists;
+    std::vector<uint32_t> stringOffsets { 0 };
+    std::string stringData;
+    uint32_t root = NONE;
+
+    // State of one execute(): variable names are resolved to registry
+    // slots up front, indexed by their string in the pool.
+    struct Frame {
+        SymbolRegistry& symbols;
+        std::vector<uint32_t> slots;
+        std::istream& input;
+        std::ostream& output;
+    };
+
+    float eval(uint32_t index, Frame& frame) const;
+    void run(uint32_t list, Frame& frame) const;
+    Token token(const Node& node, Token::Type type, std::string_view lexeme) const;
+    // Whether every index is in range and points back to an earlier node,
+    // as flatten() lays them out; checked on programs read from outside.
+    bool isWellFormed() const;
+};
+
+#endif // FLATAST_H
@@ -0,0 +1,45 @@
+#ifndef INPUTBUFFER_H
+#define INPUTBUFFER_H
+
+#include <cstddef>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+// Stream buffer that reads program input from a file descriptor.
+//
+// A regular file is mapped whole from the current offset, so input
+// redirected from a file is never copied. Anything else (a pipe, a
+// terminal) is read in large blocks. nextWord() hands out the next
+// whitespace-separated word in place, which is what `read` consumes; the
+// usual istream operations work too.
+class InputBuffer final : public std::streambuf {
+public:
+    static constexpr size_t DEFAULT_BLOCK = 64 * 1024;
+
+    explicit InputBuffer(int fd, size_t block = DEFAULT_BLOCK);
+    ~InputBuffer() override;
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // The next word, skipping whitespace as operator>> does, or an empty
+    // view at end of input. The view is valid until the next read.
+    std::string_view nextWord();
+
+protected:
+    int_type underflow() override;
+
+private:
+    int fd;
+    size_t block;
+    std::vector<char> buffer;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    // Reads more input after the `keep` characters at gptr(), which move
+    // to the front of the buffer. False at end of input.
+    bool refill(size_t keep);
+};
+
+#endif // INPUTBUFFER_H
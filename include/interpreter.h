@@ -1,24 +1,77 @@
 #pragma once
 #include "symbolTable.h"
 #include <vector>
+#include "bytecode.h"
+#include "closure.h"
+#include "flatAst.h"
+#include "jit.h"
 #include "statement.h"
 #include <istream>
 #include <ostream>
 
 class Interpreter {
+public:
+    enum class Engine {
+        TreeWalk, // Statement::execute on the node objects
+        Flat, // FlatProgram::execute on the index-based encoding
+        Vm, // BytecodeProgram::execute on register bytecode
+        Closure, // ClosureProgram::execute on pre-bound callables
+        Jit, // TreeWalk, with eligible repeat loops run as native code
+    };
+
 private:
     SymbolRegistry symbols;
     std::istream& input;
     std::ostream& output;
+    Engine engine = Engine::TreeWalk;
+    bool integers = false;
 
 public:
     explicit Interpreter(std::istream& input = std::cin, std::ostream& output = std::cout)
         : input(input), output(output) {}
 
+    void setEngine(Engine engine)
+    {
+        this->engine = engine;
+    }
+
+    // Runs integer-only code on int64_t; see BytecodeProgram. Only the Vm
+    // engine has this.
+    void setIntegerArithmetic(bool integers)
+    {
+        this->integers = integers;
+    }
+
     void interpret(const std::vector<Statement*>& statements)
     {
+        if (engine == Engine::Flat) {
+            FlatProgram::flatten(statements).execute(symbols, input, output);
+            return;
+        }
+        if (engine == Engine::Closure) {
+            ClosureProgram::compile(statements, symbols).execute(symbols, input, output);
+            return;
+        }
+        if (engine == Engine::Vm) {
+            BytecodeProgram::compile(statements, symbols, integers).execute(symbols, input, output);
+            return;
+        }
+        if (engine == Engine::Jit) {
+            LoopJit jit(symbols);
+            run(jit.compile(statements));
+            return;
+        }
+        run(statements);
+    }
+
+private:
+    void run(const std::vector<Statement*>& statements)
+    {
+        for (const auto& stmt : statements) {
+            stmt->resolve(symbols);
+        }
         for (const auto& stmt : statements) {
             stmt->execute(symbols, input, output);
         }
     }
-};
\ No newline at end of file
+};
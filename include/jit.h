@@ -0,0 +1,106 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "arena.h"
+#include "statement.h"
+#include "symbolTable.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Native code for a `repeat` loop, made by LoopJit.
+struct NativeLoop {
+    // Runs the loop on `values`, one per variable in `slots`. Sets
+    // assigned[i] when variable i is first assigned. Returns 0, or 1 + the
+    // index in `messages` of the error that stopped it.
+    using Entry = uint32_t (*)(float* values, const float* constants, uint8_t* assigned);
+
+    Entry entry = nullptr;
+    void* code = nullptr;
+    size_t codeSize = 0;
+    std::vector<uint32_t> slots;
+    // Variables the loop may read before assigning them; if one is not
+    // defined, the loop is left to the interpreter to fail on.
+    std::vector<uint8_t> neededOnEntry;
+    std::vector<float> constants;
+    std::vector<std::string> messages;
+
+    NativeLoop() = default;
+    NativeLoop(const NativeLoop&) = delete;
+    NativeLoop& operator=(const NativeLoop&) = delete;
+    ~NativeLoop();
+};
+
+// A RepeatStatement running as native code. It prints as the loop it
+// replaces and falls back to it when the native code cannot run.
+class NativeLoopStatement : public Statement {
+private:
+    RepeatStatement* original;
+    const NativeLoop* loop;
+
+public:
+    NativeLoopStatement(RepeatStatement* original, const NativeLoop* loop)
+        : original(original)
+        , loop(loop)
+    {
+    }
+
+    RepeatStatement* getOriginal() const { return original; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        original->shiftPositions(shift);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        original->resolve(symbols);
+    }
+
+    string toString(int spaceCount) const override
+    {
+        return original->toString(spaceCount);
+    }
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override;
+};
+
+// Compiles `repeat` loops to x86-64 machine code in mmap'd executable
+// memory (Linux x86-64 only; elsewhere isSupported() is false and nothing
+// is compiled).
+//
+// A loop is compiled when its body is only assignments and nested repeat
+// loops over float arithmetic and comparisons, with at most
+// MAX_VARIABLES variables. Those variables live in SSE registers for the
+// whole loop. Anything else, such as `read`, `write` or `if`, stays with
+// the interpreter, though loops inside it are still compiled. Results,
+// including division by zero and its message, match Statement::execute().
+//
+// The rewritten program shares unchanged nodes with the input and is only
+// valid while this LoopJit lives.
+class LoopJit {
+public:
+    static constexpr size_t MAX_VARIABLES = 10;
+
+    static bool isSupported();
+
+    explicit LoopJit(SymbolRegistry& symbols)
+        : symbols(symbols)
+    {
+    }
+
+    std::vector<Statement*> compile(const std::vector<Statement*>& program);
+
+    size_t compiledLoops() const { return loops.size(); }
+
+private:
+    SymbolRegistry& symbols;
+    Arena arena;
+    std::vector<std::unique_ptr<NativeLoop>> loops;
+
+    Statement* statement(Statement* stmt);
+    ArenaList<Statement*> statements(const ArenaList<Statement*>& stmts, bool& changed);
+};
+
+#endif // JIT_H
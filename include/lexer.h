@@ -2,33 +2,87 @@
 #define LEXER_H
 
 #include "token.h"
+#include "tokenBuffer.h"
+#include <istream>
+#include <ostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <unordered_set>
 
+// The lexer does not copy the source: it scans the caller's buffer (a
+// std::string, a MappedFile, ...) in place and every token's lexeme is a view
+// into it. Keep the buffer alive for as long as the tokens or the AST built
+// from them are in use.
+//
+// Alternatively it can pull the source from a stream through a refillable
+// window, so sources larger than memory can be lexed and parsed. The window
+// only grows past its initial size to fit a single oversized token. Lexemes
+// of streamed tokens are interned in the lexer and stay valid for the
+// lexer's lifetime.
+//
+// Scanning only tracks byte offsets. nextToken() derives line/column by
+// moving a position cursor forward over the gap since the previous token;
+// tokenizeAll() skips positions entirely and leaves them to the SourceMap.
 class Lexer
 {
 public:
-    Lexer(const std::string &source);
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 64 * 1024;
+
+    Lexer(std::string_view source);
+    explicit Lexer(std::istream& input, size_t windowSize = DEFAULT_WINDOW_SIZE);
+    // Lexes source[begin..], where byte `begin` sits at `position`; used to
+    // re-lex the tail of a program after an edit.
+    Lexer(std::string_view source, size_t begin, SourceMap::Position position);
+    // Replays tokens [first, last) of an already lexed buffer, followed by
+    // ENDOFFILE, so a Parser can run over part of a program.
+    Lexer(const TokenBuffer& tokens, size_t first, size_t last);
     Token nextToken();
+    TokenBuffer tokenizeAll();
+    // Same tokens as tokenizeAll(), lexed in chunks on `threadCount` threads
+    // (0 = one per core). Diagnostics are reported in source order.
+    static TokenBuffer tokenizeParallel(std::string_view source, unsigned threadCount = 0);
     bool isAtEnd() const; // Add this method
+    // Where errors and warnings are reported; std::cerr by default.
+    void setDiagnostics(std::ostream& out) { diagnostics = &out; }
 
 private:
-    std::string source;
+    std::string_view source;
     size_t current;
+    size_t tokenStart;
+
+    // Line/column of byte `positionOffset`; only ever moves forward.
+    size_t positionOffset;
     int line;
     int column;
 
-    std::unordered_map<std::string, Token::Type> reserved_map;
+    // Streaming input; `source` is then a view of `window`.
+    std::istream* input;
+    std::string window;
+    bool inputExhausted;
+    std::unordered_set<std::string> streamedLexemes;
+
+    std::ostream* diagnostics;
+
+    // Replay of a TokenBuffer; `source` is then the buffer's source.
+    const TokenBuffer* replay;
+    size_t replayNext;
+    size_t replayEnd;
 
+    // Lexes source[begin..] where `position` is the line/column of `begin`.
+    Lexer(std::string_view source, size_t begin, SourceMap::Position position, std::ostream& diagnostics);
+    void scanAll(TokenBuffer& tokens);
     // bool isAtEnd() const;
-    void advance();
-    char peek() const;
-    char peekNext() const;
+    bool refill();
+    Token replayToken();
+    bool atEnd();
+    Token::Type scanToken();
+    void syncPosition(size_t offset);
+    void reportError(size_t offset, const std::string& message);
     bool match(char expected);
     void skipWhitespaceAndComments();
-    Token stringLiteral(int start_line, int start_column);
-    Token numberLiteral(int start_line, int start_column);
-    Token identifierOrKeyword(int start_line, int start_column);
+    Token::Type stringLiteral();
+    Token::Type numberLiteral();
+    Token::Type identifierOrKeyword();
 };
 
 #endif // LEXER_H
@@ -0,0 +1,35 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file. The file is mmapped when possible, so
+// handing view() to the Lexer lexes the program without ever copying it.
+// Files that cannot be mapped (pipes, empty files) are read into an owned
+// buffer instead.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return mapping ? static_cast<const char*>(mapping) : fallback.data(); }
+    size_t size() const { return mapping ? mappingSize : fallback.size(); }
+    std::string_view view() const { return std::string_view(data(), size()); }
+
+private:
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    std::string fallback;
+    bool opened = false;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,117 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "arena.h"
+#include "expr.h"
+#include "statement.h"
+#include "typeInference.h"
+#include <map>
+#include <set>
+#include <string_view>
+#include <vector>
+
+// Rewrites a parsed program into one that runs faster with the same output
+// and the same errors. Rewritten nodes are made in `arena`; subtrees that do
+// not change are shared with the input, which is left as it was.
+//
+// Level 1 (-O1):
+//   - numeric literals are decoded once, into ConstantExpr, instead of by
+//     stof() on every evaluation;
+//   - a BinaryExpr whose operands are both constants is evaluated now and
+//     replaced by its value. One that would throw (division by zero) is left
+//     alone, so it still fails at run time, with its position;
+//   - GroupingExpression wrappers are dropped, except around a string
+//     literal, where the wrapper is what makes `write ("x")` an error.
+// Level 2 (-O2) also rewrites each `repeat` loop, using the variables the
+// loop defines (assigns or reads anywhere in it) and the variables assigned
+// on every path to it:
+//   - loop-invariant code motion: a BinaryExpr none of whose variables the
+//     loop defines is computed once, into a temporary ($t0, $t1, ...)
+//     assigned just before the loop. Only subtrees that cannot throw move:
+//     no division except by a non-zero constant, and only variables that
+//     are certainly defined when the loop starts. A loop body always runs,
+//     so the value would have been computed anyway;
+//   - strength reduction: in a counted loop, `i := k; ... repeat ...
+//     i := i + d ... until i >= n` with integer constants k, d and n, `i * c`
+//     for an integer constant c becomes a temporary set to k * c before the
+//     loop and increased by d * c right after i is. This is only done when every
+//     value involved stays within 2^24, where float arithmetic on integers
+//     is exact, so the results are the same.
+// At level 1 and above, a liveness pass then removes assignments whose value
+// is never read: overwritten first, or to a variable no `write` depends on.
+// A store whose expression could throw (division by anything but a non-zero
+// constant, a variable that may be undefined, a string) stays, so its error
+// still happens. Last, a peephole pass replaces `x := x + c`, `x := x op e`
+// and loops ending `until x op c` with the fused statements of statement.h.
+// Level 0 (-O0) returns the program unchanged.
+//
+// With `integers`, the result is for BytecodeProgram's int64 path, and keeps
+// its output there too: integer constants keep their exact value, integer
+// arithmetic is folded as int64_t, and nothing is folded, moved or removed
+// where int64_t would go on in float at run time (an overflow or a -0
+// product), since that changes every value computed after it. Stores that
+// decide a variable's type are kept (see eliminateDeadStores()).
+//
+// What was done is counted in stats().
+struct OptimizationStats {
+    size_t foldedExpressions = 0;
+    size_t hoistedExpressions = 0;
+    size_t reducedMultiplications = 0;
+    size_t removedStores = 0;
+    // Expression nodes in the removed stores.
+    size_t removedNodes = 0;
+    size_t fusedIncrements = 0;
+    size_t fusedAccumulations = 0;
+    size_t fusedLoopExits = 0;
+};
+
+class Optimizer {
+public:
+    Optimizer(Arena& arena, int level, bool integers = false)
+        : arena(arena)
+        , level(level)
+        , integers(integers)
+    {
+    }
+
+    std::vector<Statement*> optimize(const std::vector<Statement*>& program);
+
+    const OptimizationStats& stats() const { return counts; }
+
+private:
+    Arena& arena;
+    int level;
+    bool integers;
+    OptimizationStats counts;
+    // The program's types on the int64 path, when optimizing for it.
+    TypeInference types;
+
+    Statement* statement(Statement* stmt);
+    ArenaList<Statement*> statements(const ArenaList<Statement*>& stmts, bool& changed);
+    Expr* expr(Expr* e);
+    Expr* fold(BinaryExpr* binary, Expr* left, Expr* right);
+
+    using Names = std::set<std::string_view>;
+    using Definitions = std::map<std::string_view, int>;
+    using Constants = std::map<std::string_view, float>;
+
+    size_t temporaries = 0;
+
+    std::vector<Statement*> loops(const std::vector<Statement*>& stmts, Names& assigned, Constants& known);
+    static void forget(const Statement* stmt, Constants& known);
+    void optimizeLoop(RepeatStatement* loop, const Names& entry, const Constants& known, std::vector<Statement*>& out);
+    bool reduceStrength(std::vector<Statement*>& body, Expr*& condition, const Constants& known, Definitions& definitions, std::vector<Statement*>& out);
+    bool hoistInvariants(std::vector<Statement*>& body, Expr*& condition, const Definitions& definitions, const Names& entry, std::vector<Statement*>& out);
+    Token temporary();
+    std::vector<Statement*> eliminateDeadStores(const std::vector<Statement*>& program);
+    static void findRemovableStores(const std::vector<Statement*>& stmts, Names& assigned, const TypeInference* types, std::set<const Statement*>& removable);
+    Statement* fuse(Statement* stmt);
+    ArenaList<Statement*> fuse(const ArenaList<Statement*>& stmts);
+    std::vector<Statement*> removeDeadStores(const std::vector<Statement*>& stmts, Names& live, const std::set<const Statement*>& removable, bool rebuild);
+    template <typename Replace>
+    Statement* rewrite(Statement* stmt, Replace& replace);
+    template <typename Replace>
+    Expr* rewrite(Expr* e, Replace& replace);
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,68 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+// Stream buffer that writes program output straight to a file descriptor.
+//
+// Output collects in one large buffer and goes out in a single write()
+// when the buffer is full, when the stream is flushed, or when a line ends
+// at least `interval` after the last write (so the first line of a run
+// goes out at once). Memory stays bounded however much a program prints.
+// Time is only looked at when a line ends: lines written just before a
+// long computation wait for the next line, a full buffer or a flush.
+class OutputSink final : public std::streambuf {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    static constexpr std::chrono::milliseconds DEFAULT_INTERVAL { 50 };
+
+    explicit OutputSink(int fd, size_t capacity = DEFAULT_CAPACITY,
+        std::chrono::milliseconds interval = DEFAULT_INTERVAL);
+    ~OutputSink() override;
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // Called after each complete line; writes the buffer out if the last
+    // write was at least the interval ago.
+    void endOfLine()
+    {
+        if (pptr() != pbase() && std::chrono::steady_clock::now() >= deadline) {
+            drain();
+        }
+    }
+
+    size_t writeCalls() const { return writes; }
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    int fd;
+    std::vector<char> buffer;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point deadline;
+    size_t writes = 0;
+    bool failed = false;
+
+    bool drain();
+    bool writeAll(const char* data, size_t size);
+};
+
+// Ends a line of program output. Unlike std::endl this does not flush;
+// an OutputSink decides for itself when the line goes out.
+inline void endLine(std::ostream& output)
+{
+    output.put('\n');
+    if (auto* sink = dynamic_cast<OutputSink*>(output.rdbuf())) {
+        sink->endOfLine();
+    }
+}
+
+#endif // OUTPUTSINK_H
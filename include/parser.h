@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
 #include "expr.h"
 #include "lexer.h"
 #include "statement.h"
@@ -8,25 +9,83 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
+// A change to program text: the `removedLength` bytes at `offset` are
+// replaced by `insertedText`.
+struct TextEdit {
+    size_t offset;
+    size_t removedLength;
+    string insertedText;
+
+    // The single edit that turns `before` into `after`, spanning everything
+    // between their common prefix and common suffix.
+    static TextEdit between(string_view before, string_view after);
+};
+
+// Where a top-level statement lies in the text: bytes [begin, end), the
+// first of which is at line/column.
+struct StatementSpan {
+    size_t begin;
+    size_t end;
+    int line;
+    int column;
+};
+
+// Result of a parse that owns its tree: every node in `statements` lives in
+// `arena` and is released along with it.
+//
+// Results of Parser::parseText() and Parser::reparse() also own the text
+// they were parsed from, so they can be updated edit by edit. Statements
+// reused from earlier parses still live in the arenas of those parses and
+// point into their text, so both are kept in `retained`.
+struct ParseResult {
+    unique_ptr<Arena> arena;
+    vector<Statement*> statements;
+    vector<string> errors;
+
+    unique_ptr<string> source;
+    vector<StatementSpan> spans;
+    struct Retained {
+        unique_ptr<Arena> arena;
+        unique_ptr<string> source;
+    };
+    vector<Retained> retained;
+
+    bool isError() const
+    {
+        return !errors.empty();
+    }
+};
+
 class Parser {
 private:
     Lexer& lexer;
     Token currentToken;
     Token previousToken;
     vector<string> errors;
+    unique_ptr<Arena> arena;
+    // Set by parseText()/reparse(): the text being lexed, and where to
+    // record the span of each top-level statement.
+    const char* spanSource = nullptr;
+    vector<StatementSpan>* spans = nullptr;
+
+    // reparse() falls back to a full parse once this many earlier parses
+    // are being kept alive, so memory stays bounded across edits.
+    static constexpr size_t MAX_RETAINED_PARSES = 8;
 
     void advance();
-    Token previous();
+    const Token& previous();
     void consume(Token::Type type, const string& message);
     bool match(Token::Type type);
     bool check(Token::Type type);
 
     vector<Statement*> program();
     Statement* statement();
+    Statement* spannedStatement();
     Statement* assignment();
     Statement* ifStatement();
     Statement* repeatStatement();
@@ -34,10 +93,7 @@ private:
     Statement* readStatement();
 
     Expr* expression();
-    Expr* equality();
-    Expr* comparison();
-    Expr* term();
-    Expr* factor();
+    Expr* expression(int minPrecedence);
     Expr* primary();
 
     void synchronize();
@@ -45,7 +101,27 @@ private:
     void addError(const Token& token, const string& message);
 public:
     Parser(Lexer& lexer);
+    // Nodes returned by parse() belong to the parser and are freed with it.
     vector<Statement*> parse();
+    // Parses and hands the tree, and the arena holding it, to the caller.
+    ParseResult parseProgram();
+
+    // Parses `source` into a result that keeps the text, for use with
+    // reparse().
+    static ParseResult parseText(string source);
+    // Applies `edit` to the text of `previous` (a result of parseText() or
+    // reparse()) and re-lexes and re-parses only the top-level statements
+    // the edit can affect. The other statements are taken over from
+    // `previous`, with their tokens moved to their new lines and columns;
+    // their lexemes keep pointing into the text of `previous`. The result is the
+    // same as parseText() of the edited text, except that lexer diagnostics
+    // are only reported again for the re-lexed region. If `previous` or the
+    // edited text has syntax errors, the whole text is parsed again.
+    static ParseResult reparse(ParseResult previous, const TextEdit& edit);
+    // Same result as parseProgram() over `source`, with top-level
+    // statements parsed on `threadCount` threads (0 = one per core). The
+    // source is lexed with Lexer::tokenizeParallel() first.
+    static ParseResult parseParallel(string_view source, unsigned threadCount = 0);
     bool isError() const
     {
         return !errors.empty();
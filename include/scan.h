@@ -0,0 +1,32 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+
+// Byte-scanning primitives used by the lexer's hot loops. Each one has a
+// scalar version, an SSE2 version and an AVX2 version; the widest one the CPU
+// supports is picked on first use.
+namespace scan {
+
+enum class Isa {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+Isa activeIsa();
+// Forces a narrower implementation (for benchmarks). Requests for an ISA the
+// CPU lacks fall back to the best available one. Returns the ISA in effect.
+Isa useIsa(Isa isa);
+const char* isaName(Isa isa);
+
+// First occurrence of `c` in [p, end), or `end`.
+const char* findByte(const char* p, const char* end, char c);
+// First byte in [p, end) that is not C-locale whitespace, or `end`.
+const char* skipWhitespace(const char* p, const char* end);
+// Number of occurrences of `c` in [p, end).
+size_t countByte(const char* p, const char* end, char c);
+
+} // namespace scan
+
+#endif // SCAN_H
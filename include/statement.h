@@ -1,21 +1,41 @@
 #ifndef STATEMENT_H
 #define STATEMENT_H
 
+#include "arena.h"
 #include "expr.h"
+#include "outputSink.h"
 #include "symbolTable.h"
 #include "token.h"
+#include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
 #include <variant>
 #include <vector>
-#include <regex>
+
+// Reads the next whitespace-separated word from `input` as the integer
+// value of `identifier`, the way every `read` does. The word must be
+// -?[0-9]+; the value is the one stof() gives, including its
+// out_of_range("stof") beyond a float. Defined with InputBuffer, whose
+// words it parses in place.
+float readInputValue(std::istream& input, const Token& identifier);
+
+// readInputValue() for integer variables on the int64 path: true with the
+// exact digits in `integer`, or false with readInputValue()'s result in
+// `value` for input an int64_t cannot stand for (beyond its range, or -0).
+bool readInputInteger(std::istream& input, const Token& identifier, int64_t& integer, float& value);
 
 class Statement {
 public:
     virtual ~Statement() = default;
     virtual string toString(int spaceCount = 0) const = 0;
     virtual void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const = 0;
+    // Moves the line/column of every token in the statement; see
+    // Parser::reparse().
+    virtual void shiftPositions(const PositionShift& shift) = 0;
+    // Binds every variable in the statement to its slot in `symbols`; run
+    // before executing against that registry.
+    virtual void resolve(SymbolRegistry& symbols) = 0;
 
     string indentStringWithSpaces(int spaceCount, const string& str) const
     {
@@ -27,6 +47,7 @@ class AssignmentStatement : public Statement {
 private:
     Token identifier;
     Expr* expression;
+    uint32_t slot = SymbolRegistry::NO_SLOT;
 
 public:
     AssignmentStatement(const Token& identifier, Expr* expression)
@@ -35,31 +56,79 @@ public:
     {
     }
 
+    const Token& getIdentifier() const { return identifier; }
+    Expr* getExpression() const { return expression; }
+    // The registry slot of the target, or NO_SLOT before resolve().
+    uint32_t getSlot() const { return slot; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        shift.apply(identifier);
+        expression->shiftPositions(shift);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        slot = symbols.slot(identifier.lexeme);
+        expression->resolve(symbols);
+    }
+
     string toString(int spaceCount = 0) const override
     {
-        return indentStringWithSpaces(spaceCount, "AssignmentStatement(" + identifier.lexeme + ", ") + expression->toString() + ");\n";
+        return indentStringWithSpaces(spaceCount, "AssignmentStatement(" + string(identifier.lexeme) + ", ") + expression->toString() + ");\n";
     }
 
     void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override
     {
-        symbols.set(identifier.lexeme, expression->eval(symbols));
+        float value = expression->eval(symbols);
+        if (slot != SymbolRegistry::NO_SLOT) {
+            symbols.set(slot, value);
+        } else {
+            symbols.set(string(identifier.lexeme), value);
+        }
     }
 };
 
 class IfStatement : public Statement {
 private:
     Expr* condition;
-    vector<Statement*> thenBranch;
-    vector<Statement*> elseBranch;
+    ArenaList<Statement*> thenBranch;
+    ArenaList<Statement*> elseBranch;
 
 public:
-    IfStatement(Expr* condition, const vector<Statement*>& thenBranch, const vector<Statement*>& elseBranch)
+    IfStatement(Expr* condition, ArenaList<Statement*> thenBranch, ArenaList<Statement*> elseBranch)
         : condition(condition)
         , thenBranch(thenBranch)
         , elseBranch(elseBranch)
     {
     }
 
+    Expr* getCondition() const { return condition; }
+    const ArenaList<Statement*>& getThenBranch() const { return thenBranch; }
+    const ArenaList<Statement*>& getElseBranch() const { return elseBranch; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        condition->shiftPositions(shift);
+        for (Statement* stmt : thenBranch) {
+            stmt->shiftPositions(shift);
+        }
+        for (Statement* stmt : elseBranch) {
+            stmt->shiftPositions(shift);
+        }
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        condition->resolve(symbols);
+        for (Statement* stmt : thenBranch) {
+            stmt->resolve(symbols);
+        }
+        for (Statement* stmt : elseBranch) {
+            stmt->resolve(symbols);
+        }
+    }
+
     string toString(int spaceCount) const override
     {
         string result = indentStringWithSpaces(spaceCount, "IfStatement(") + condition->toString() + ") Then\n";
@@ -93,16 +162,35 @@ public:
 
 class RepeatStatement : public Statement {
 private:
-    vector<Statement*> body;
+    ArenaList<Statement*> body;
     Expr* condition;
 
 public:
-    RepeatStatement(const vector<Statement*>& body, Expr* condition)
+    RepeatStatement(ArenaList<Statement*> body, Expr* condition)
         : body(body)
         , condition(condition)
     {
     }
 
+    const ArenaList<Statement*>& getBody() const { return body; }
+    Expr* getCondition() const { return condition; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        for (Statement* stmt : body) {
+            stmt->shiftPositions(shift);
+        }
+        condition->shiftPositions(shift);
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        for (Statement* stmt : body) {
+            stmt->resolve(symbols);
+        }
+        condition->resolve(symbols);
+    }
+
     string toString(int spaceCount) const override
     {
         string result = indentStringWithSpaces(spaceCount, "RepeatStatement\n");
@@ -125,14 +213,30 @@ public:
 
 class WriteStatement : public Statement {
 private:
-    vector<Expr*> operands;
+    ArenaList<Expr*> operands;
 
 public:
-    WriteStatement(const vector<Expr*>& operands)
+    WriteStatement(ArenaList<Expr*> operands)
         : operands(operands)
     {
     }
 
+    const ArenaList<Expr*>& getOperands() const { return operands; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        for (Expr* operand : operands) {
+            operand->shiftPositions(shift);
+        }
+    }
+
+    void resolve(SymbolRegistry& symbols) override
+    {
+        for (Expr* operand : operands) {
+            operand->resolve(symbols);
+        }
+    }
+
     string toString(int spaceCount) const override
     {
         string result = indentStringWithSpaces(spaceCount, "WriteStatement(");
@@ -155,20 +259,35 @@ public:
                 output << operand->eval(symbols);
             }
         }
-        output << std::endl;
+        endLine(output);
     }
 };
 
 class ReadStatement : public Statement {
 private:
-    vector<Token> identifiers;
+    ArenaList<Token> identifiers;
 
 public:
-    ReadStatement(const vector<Token>& identifiers)
+    ReadStatement(ArenaList<Token> identifiers)
         : identifiers(identifiers)
     {
     }
 
+    const ArenaList<Token>& getIdentifiers() const { return identifiers; }
+
+    void shiftPositions(const PositionShift& shift) override
+    {
+        for (Token& identifier : identifiers) {
+            shift.apply(identifier);
+        }
+    }
+
+    // Reads are bound to their input, not to variable lookups, so they
+    // keep going by name.
+    void resolve(SymbolRegistry& symbols) override
+    {
+    }
+
     string toString(int spaceCount) const override
     {
         string result = indentStringWithSpaces(spaceCount, "ReadStatement(");
@@ -185,17 +304,96 @@ public:
     void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override
     {
         for (const auto& identifier : identifiers) {
-            std::string inputStr;
-            input >> inputStr;
-
-            // Check if the input is a valid number
-            std::regex numberRegex(R"(^-?\d+$)");
-            bool isNumber = std::regex_match(inputStr, numberRegex);
-            if (!isNumber) {
-                throw std::runtime_error("Invalid input for variable '" + identifier.lexeme + "': " + inputStr + " at line " + std::to_string(identifier.start_line) + ", column " + std::to_string(identifier.start_column));
-            }
-            symbols.set(identifier.lexeme, std::stof(inputStr));
+            symbols.set(std::string(identifier.lexeme), readInputValue(input, identifier));
+        }
+    }
+};
+
+// Fused forms of common statement idioms, made by the Optimizer's peephole
+// pass. Each is still the AssignmentStatement or RepeatStatement it
+// replaces, with the same children and printed form, so passes and other
+// engines see no difference; only execute() is shortcut. Values and errors
+// are those of the unfused statement.
+
+// `x := x + c`, `x := c + x` or `x := x - c` for a constant c: x is updated
+// in place, with no expression nodes evaluated.
+class IncrementStatement final : public AssignmentStatement {
+private:
+    const VariableExpr* variable;
+    float delta;
+
+public:
+    // `variable` is the x read by `expression`; x - c is x + -c exactly.
+    IncrementStatement(const Token& identifier, Expr* expression, const VariableExpr* variable, float delta)
+        : AssignmentStatement(identifier, expression)
+        , variable(variable)
+        , delta(delta)
+    {
+    }
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override
+    {
+        if (getSlot() == SymbolRegistry::NO_SLOT) {
+            AssignmentStatement::execute(symbols, input, output);
+            return;
+        }
+        symbols.set(getSlot(), variable->VariableExpr::eval(symbols) + delta);
+    }
+};
+
+// `x := x op e` for op +, - or *, such as `fact := fact * n` or
+// `s := s + a * b`: x is read and written in place around e.
+template <typename Op>
+class AccumulateStatement final : public AssignmentStatement {
+private:
+    const BinaryExpr* binary;
+    const VariableExpr* variable;
+
+public:
+    AccumulateStatement(const Token& identifier, BinaryExpr* expression)
+        : AssignmentStatement(identifier, expression)
+        , binary(expression)
+        , variable(static_cast<const VariableExpr*>(expression->getLeft()))
+    {
+    }
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override
+    {
+        if (getSlot() == SymbolRegistry::NO_SLOT) {
+            AssignmentStatement::execute(symbols, input, output);
+            return;
         }
+        float current = variable->VariableExpr::eval(symbols);
+        symbols.set(getSlot(), Op::apply(current, binary->getRight()->eval(symbols), binary->getOperator()));
+    }
+};
+
+// A repeat loop whose exit test is `x op c`, a comparison of a variable with
+// a constant, such as `until x = 0`: the test is done inline.
+template <typename Op>
+class RepeatUntilCompareStatement final : public RepeatStatement {
+private:
+    const BinaryExpr* test;
+    const VariableExpr* variable;
+    float limit;
+
+public:
+    RepeatUntilCompareStatement(ArenaList<Statement*> body, BinaryExpr* condition, float limit)
+        : RepeatStatement(body, condition)
+        , test(condition)
+        , variable(static_cast<const VariableExpr*>(condition->getLeft()))
+        , limit(limit)
+    {
+    }
+
+    void execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const override
+    {
+        const ArenaList<Statement*>& body = getBody();
+        do {
+            for (const auto& stmt : body) {
+                stmt->execute(symbols, input, output);
+            }
+        } while (!Op::apply(variable->VariableExpr::eval(symbols), limit, test->getOperator()));
     }
 };
 
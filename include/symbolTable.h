@@ -1,28 +1,72 @@
 #ifndef SYMBOLTABLE_H
 #define SYMBOLTABLE_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <stdexcept>
+#include <vector>
 #include "token.h"
 
+// Variable storage. Every variable name gets a dense slot index the first
+// time it is seen; values live in a flat array indexed by slot. The
+// interpreter resolves each variable reference to its slot once, before
+// running, so evaluation never hashes or compares names. The name-based
+// get()/set() remain as a view for debugging and output.
 class SymbolRegistry {
 private:
-    std::unordered_map<std::string, float> table;
+    std::unordered_map<std::string, uint32_t> slots;
+    std::vector<std::string> names;
+    std::vector<float> values;
+    std::vector<uint8_t> defined;
 
 public:
+    // Slot index of a reference that has not been resolved.
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    // Slot of `name`, created (as undefined) if the name is new.
+    uint32_t slot(std::string_view name) {
+        auto it = slots.find(std::string(name));
+        if (it != slots.end()) {
+            return it->second;
+        }
+        uint32_t index = static_cast<uint32_t>(names.size());
+        slots.emplace(std::string(name), index);
+        names.emplace_back(name);
+        values.push_back(0);
+        defined.push_back(0);
+        return index;
+    }
+
+    void set(uint32_t slot, float value) {
+        values[slot] = value;
+        defined[slot] = 1;
+    }
+
+    float get(uint32_t slot) const {
+        if (!defined[slot]) {
+            throw std::runtime_error("Undefined variable: " + names[slot]);
+        }
+        return values[slot];
+    }
+
     void set(const std::string& name, float value) {
-        table[name] = value;
+        set(slot(name), value);
     }
 
     float get(const std::string& name) const {
-        auto it = table.find(name);
-        if (it == table.end()) {
+        auto it = slots.find(name);
+        if (it == slots.end()) {
             throw std::runtime_error("Undefined variable: " + name);
         }
-        return it->second;
+        return get(it->second);
     }
+
+    size_t size() const { return names.size(); }
+    const std::string& name(uint32_t slot) const { return names[slot]; }
+    bool isDefined(uint32_t slot) const { return defined[slot] != 0; }
 };
 
 
-#endif // SYMBOLTABLE_H
\ No newline at end of file
+#endif // SYMBOLTABLE_H
@@ -1,11 +1,13 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 struct Token
 {
-    enum class Type
+    enum class Type : uint8_t
     {
         IDENTIFIER,
         LITERAL,
@@ -39,16 +41,33 @@ struct Token
     };
 
     Type type;
-    std::string lexeme;
+    // Points into the source buffer the lexer was given (or at a static
+    // spelling for operators), so the buffer must outlive the token.
+    std::string_view lexeme;
     int start_line;
     int start_column;
     int end_line;
     int end_column;
 
-    Token(Type type, const std::string &lexeme, int start_line, int start_column, int end_line, int end_column);
+    Token(Type type, std::string_view lexeme, int start_line, int start_column, int end_line, int end_column);
 
     static std::string getTokenTypeName(Token::Type type);
+    // Source text of keywords and operators; empty for tokens whose text
+    // varies (identifiers, numbers, literals) and for ENDOFFILE.
+    static std::string_view getSpelling(Token::Type type);
     std::string toString() const;
 };
 
+// How the positions of tokens after an edit move: lines shift by
+// `lineDelta`, and columns of tokens on `line` (the old line the edit ended
+// on) also shift by `columnDelta`.
+struct PositionShift
+{
+    int line;
+    int lineDelta;
+    int columnDelta;
+
+    void apply(Token& token) const;
+};
+
 #endif // TOKEN_H
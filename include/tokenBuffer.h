@@ -0,0 +1,66 @@
+#ifndef TOKENBUFFER_H
+#define TOKENBUFFER_H
+
+#include "token.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Table of line start offsets for a source buffer. Built once in a single
+// pass; line/column of any byte offset is then a binary search away.
+class SourceMap {
+public:
+    struct Position {
+        int line;
+        int column;
+    };
+
+    SourceMap() = default;
+    explicit SourceMap(std::string_view source);
+
+    Position position(size_t offset) const;
+    size_t lineCount() const { return lineStarts.size(); }
+    size_t lineStart(int line) const { return lineStarts[line - 1]; }
+
+private:
+    std::vector<size_t> lineStarts;
+};
+
+// Struct-of-arrays token stream produced by Lexer::tokenizeAll(): one type
+// byte plus a 32-bit source offset and length per token, instead of a
+// 40-byte Token. Positions are not tracked while lexing; token(i) and
+// position() look them up from the SourceMap on demand.
+class TokenBuffer {
+public:
+    TokenBuffer() = default;
+    explicit TokenBuffer(std::string_view source);
+
+    void push(Token::Type type, size_t offset, size_t length);
+    void reserve(size_t count);
+    void append(const TokenBuffer& other, size_t first, size_t last);
+    void finish(); // builds the SourceMap; call once all tokens are pushed
+    void finish(SourceMap lines);
+
+    size_t size() const { return types.size(); }
+    Token::Type type(size_t i) const { return types[i]; }
+    uint32_t offset(size_t i) const { return offsets[i]; }
+    uint32_t length(size_t i) const { return lengths[i]; }
+    std::string_view text(size_t i) const { return source.substr(offsets[i], lengths[i]); }
+    std::string_view lexeme(size_t i) const;
+
+    // Fully materialized token, positions included.
+    Token token(size_t i) const;
+    SourceMap::Position position(size_t offset) const { return lines.position(offset); }
+
+    std::string_view getSource() const { return source; }
+    const SourceMap& getSourceMap() const { return lines; }
+
+private:
+    std::string_view source;
+    std::vector<Token::Type> types;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    SourceMap lines;
+};
+
+#endif // TOKENBUFFER_H
@@ -0,0 +1,39 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include "expr.h"
+#include "statement.h"
+#include "symbolTable.h"
+#include <cstdint>
+#include <set>
+#include <string_view>
+#include <vector>
+
+// Which variables and expressions of a program only ever hold integers, for
+// running them on int64_t instead of float.
+//
+// An expression is an integer if it is an integer literal, a variable that
+// is one, or +, -, * or a comparison of two integers. Division always gives
+// a float. A variable is an integer unless some assignment to it is not, or
+// it already holds a value in the registry; `read` only accepts integers.
+// This is found by demoting variables until nothing changes, since whether
+// an assignment is an integer depends on the variables it reads.
+class TypeInference {
+public:
+    static TypeInference infer(const std::vector<Statement*>& program, const SymbolRegistry& symbols);
+
+    bool isInteger(std::string_view variable) const { return floats.count(variable) == 0; }
+    bool isInteger(const Expr* e) const;
+
+    // The exact value of an integer literal, or of a ConstantExpr the
+    // Optimizer made for one.
+    static bool integerConstant(const Expr* e, int64_t& value);
+
+private:
+    // Variables that may hold a value that is not an integer.
+    std::set<std::string_view> floats;
+
+    bool demote(const Statement* stmt);
+};
+
+#endif // TYPE_INFERENCE_H
@@ -0,0 +1,180 @@
+#include "inputBuffer.h"
+#include "statement.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// The characters operator>> skips in the classic locale.
+bool isSpace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// The next word of `input` for `identifier`, checked to be -?[0-9]+. From
+// an InputBuffer the word is taken where it lies; any other stream reads
+// it into `storage` with operator>>.
+std::string_view readInputWord(std::istream& input, const Token& identifier, std::string& storage)
+{
+    std::string_view word;
+    if (auto* buffer = dynamic_cast<InputBuffer*>(input.rdbuf())) {
+        if (std::ostream* tied = input.tie()) {
+            tied->flush();
+        }
+        word = buffer->nextWord();
+    } else {
+        input >> storage;
+        word = storage;
+    }
+
+    size_t digit = !word.empty() && word[0] == '-';
+    bool isNumber = digit < word.size();
+    for (; isNumber && digit < word.size(); ++digit) {
+        isNumber = word[digit] >= '0' && word[digit] <= '9';
+    }
+    if (!isNumber) {
+        throw std::runtime_error("Invalid input for variable '" + std::string(identifier.lexeme) + "': " + std::string(word) + " at line " + std::to_string(identifier.start_line) + ", column " + std::to_string(identifier.start_column));
+    }
+    return word;
+}
+
+} // namespace
+
+InputBuffer::InputBuffer(int fd, size_t block)
+    : fd(fd)
+    , block(block > 0 ? block : 1)
+{
+    struct stat info;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > offset) {
+        // mmap() wants a page-aligned offset; start the get area part way in.
+        off_t aligned = offset - offset % sysconf(_SC_PAGESIZE);
+        void* addr = mmap(nullptr, info.st_size - aligned, PROT_READ, MAP_PRIVATE, fd, aligned);
+        if (addr != MAP_FAILED) {
+            madvise(addr, info.st_size - aligned, MADV_SEQUENTIAL);
+            mapping = addr;
+            mappingSize = info.st_size - aligned;
+            char* begin = static_cast<char*>(addr);
+            setg(begin, begin + (offset - aligned), begin + mappingSize);
+            return;
+        }
+    }
+    buffer.resize(this->block);
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+InputBuffer::~InputBuffer()
+{
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+std::string_view InputBuffer::nextWord()
+{
+    while (true) {
+        const char* next = gptr();
+        while (next < egptr() && isSpace(*next)) {
+            ++next;
+        }
+        setg(eback(), const_cast<char*>(next), egptr());
+        if (next < egptr()) {
+            break;
+        }
+        if (!refill(0)) {
+            return {};
+        }
+    }
+
+    size_t length = 0;
+    while (true) {
+        const char* start = gptr();
+        while (start + length < egptr() && !isSpace(start[length])) {
+            ++length;
+        }
+        // A word running into the end of the buffer may go on in the next
+        // block.
+        if (start + length < egptr() || !refill(length)) {
+            break;
+        }
+    }
+    std::string_view word(gptr(), length);
+    setg(eback(), gptr() + length, egptr());
+    return word;
+}
+
+InputBuffer::int_type InputBuffer::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    return refill(0) ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+}
+
+bool InputBuffer::refill(size_t keep)
+{
+    if (mapping) {
+        return false;
+    }
+    size_t from = gptr() - buffer.data();
+    std::memmove(buffer.data(), buffer.data() + from, keep);
+    if (buffer.size() < keep + block) {
+        buffer.resize(keep + block);
+    }
+
+    ssize_t count;
+    do {
+        count = ::read(fd, buffer.data() + keep, buffer.size() - keep);
+    } while (count < 0 && errno == EINTR);
+    setg(buffer.data(), buffer.data(), buffer.data() + keep + (count > 0 ? count : 0));
+    return count > 0;
+}
+
+namespace {
+
+// The value stof() gives for a word readInputWord() accepted.
+float wordValue(std::string_view word)
+{
+    bool negative = word[0] == '-';
+    if (word.size() - negative <= 18) {
+        // Up to 18 digits fit an int64_t exactly, and converting that to
+        // float rounds once, to nearest, just as stof() does.
+        int64_t value = 0;
+        for (char c : word.substr(negative)) {
+            value = value * 10 + (c - '0');
+        }
+        return negative ? -float(value) : float(value);
+    }
+    float value;
+    if (std::from_chars(word.data(), word.data() + word.size(), value).ec != std::errc()) {
+        throw std::out_of_range("stof");
+    }
+    return value;
+}
+
+} // namespace
+
+float readInputValue(std::istream& input, const Token& identifier)
+{
+    std::string storage;
+    return wordValue(readInputWord(input, identifier, storage));
+}
+
+bool readInputInteger(std::istream& input, const Token& identifier, int64_t& integer, float& value)
+{
+    std::string storage;
+    std::string_view word = readInputWord(input, identifier, storage);
+    int64_t parsed;
+    if (std::from_chars(word.data(), word.data() + word.size(), parsed).ec == std::errc() && (parsed != 0 || word[0] != '-')) {
+        integer = parsed;
+        return true;
+    }
+    value = wordValue(word);
+    return false;
+}
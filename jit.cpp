@@ -0,0 +1,617 @@
+#include "jit.h"
+#include "expr.h"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define TINY_JIT 1
+#endif
+
+NativeLoop::~NativeLoop()
+{
+#ifdef TINY_JIT
+    if (code != nullptr) {
+        munmap(code, codeSize);
+    }
+#endif
+}
+
+void NativeLoopStatement::execute(SymbolRegistry& symbols, std::istream& input, std::ostream& output) const
+{
+    size_t count = loop->slots.size();
+    float values[LoopJit::MAX_VARIABLES] = {};
+    uint8_t definedOnEntry[LoopJit::MAX_VARIABLES] = {};
+    uint8_t assigned[LoopJit::MAX_VARIABLES] = {};
+    for (size_t i = 0; i < count; i++) {
+        if (symbols.isDefined(loop->slots[i])) {
+            values[i] = symbols.get(loop->slots[i]);
+            definedOnEntry[i] = 1;
+        } else if (loop->neededOnEntry[i]) {
+            original->execute(symbols, input, output);
+            return;
+        }
+    }
+
+    uint32_t result = loop->entry(values, loop->constants.data(), assigned);
+    for (size_t i = 0; i < count; i++) {
+        if (definedOnEntry[i] || assigned[i]) {
+            symbols.set(loop->slots[i], values[i]);
+        }
+    }
+    if (result != 0) {
+        throw std::runtime_error(loop->messages[result - 1]);
+    }
+}
+
+#ifdef TINY_JIT
+
+namespace {
+
+// Thrown while compiling a loop the JIT does not handle.
+struct Unsupported {
+};
+
+// Register use in generated code:
+//   rdi = values, rsi = constants, rdx = assigned flags (the arguments)
+//   xmm0..xmm5  expression temporaries
+//   xmm6..xmm15 the loop's variables
+// Every xmm register is caller-saved in the System V ABI, so there is no
+// prologue beyond loading the variables.
+const int RSI = 6;
+const int RDI = 7;
+const int TEMPORARIES = 6;
+const int FIRST_VARIABLE = 6;
+
+enum : uint8_t {
+    MOVSS = 0x10,
+    MOVSS_STORE = 0x11,
+    MOVAPS = 0x28,
+    UCOMISS = 0x2E,
+    ANDPS = 0x54,
+    ADDSS = 0x58,
+    MULSS = 0x59,
+    SUBSS = 0x5C,
+    DIVSS = 0x5E,
+    CMPSS = 0xC2,
+};
+
+// Condition codes for Jcc.
+enum : uint8_t {
+    BELOW = 0x2,
+    ABOVE_EQUAL = 0x3,
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    BELOW_EQUAL = 0x6,
+    ABOVE = 0x7,
+    PARITY = 0xA,
+};
+
+// cmpss predicates.
+enum : uint8_t {
+    CMP_EQ = 0,
+    CMP_LT = 1,
+    CMP_LE = 2,
+    CMP_NEQ = 4,
+};
+
+// An SSE source operand: a register, or a constant in the pool.
+struct Operand {
+    bool memory;
+    int reg;
+    int32_t offset;
+};
+
+class X86LoopCompiler {
+public:
+    X86LoopCompiler(SymbolRegistry& symbols, NativeLoop& loop)
+        : symbols(symbols)
+        , loop(loop)
+    {
+        constant(0.0f);
+        constant(1.0f);
+    }
+
+    // Machine code for `repeat`; throws Unsupported.
+    std::vector<uint8_t> compile(const RepeatStatement* repeat)
+    {
+        collect(repeat);
+        for (size_t i = 0; i < loop.slots.size(); i++) {
+            sseMemory(0xF3, MOVSS, variable(i), RDI, static_cast<int32_t>(4 * i));
+        }
+        assigned.assign(loop.slots.size(), false);
+        loop.neededOnEntry.assign(loop.slots.size(), 0);
+        statement(repeat);
+
+        storeVariables();
+        code.push_back(0x31); // xor eax, eax
+        code.push_back(0xC0);
+        code.push_back(0xC3); // ret
+
+        for (size_t site = 0; site < failures.size(); site++) {
+            for (size_t jump : failures[site]) {
+                patch(jump);
+            }
+            storeVariables();
+            code.push_back(0xB8); // mov eax, imm32
+            append32(static_cast<uint32_t>(site + 1));
+            code.push_back(0xC3);
+        }
+        return code;
+    }
+
+private:
+    SymbolRegistry& symbols;
+    NativeLoop& loop;
+    std::vector<uint8_t> code;
+    std::unordered_map<uint32_t, size_t> variables;
+    std::unordered_map<uint32_t, int32_t> constants;
+    // Variables assigned on every path so far; reads of others need the
+    // value the loop started with.
+    std::vector<bool> assigned;
+    // Jumps to each error exit, by message index.
+    std::vector<std::vector<size_t>> failures;
+
+    // Finds the loop's variables, failing on anything not compiled.
+    void collect(const Statement* stmt)
+    {
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            addVariable(assignment->getIdentifier().lexeme);
+            collect(assignment->getExpression());
+        } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            for (const Statement* inner : repeat->getBody()) {
+                collect(inner);
+            }
+            collect(repeat->getCondition());
+        } else {
+            throw Unsupported();
+        }
+    }
+
+    void collect(const Expr* e)
+    {
+        if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+            collect(binary->getLeft());
+            collect(binary->getRight());
+        } else if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            collect(grouping->getExpression());
+        } else if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            addVariable(variable->getIdentifier().lexeme);
+        }
+    }
+
+    void addVariable(std::string_view name)
+    {
+        uint32_t slot = symbols.slot(name);
+        if (variables.emplace(slot, loop.slots.size()).second) {
+            if (loop.slots.size() == LoopJit::MAX_VARIABLES) {
+                throw Unsupported();
+            }
+            loop.slots.push_back(slot);
+        }
+    }
+
+    static int variable(size_t index)
+    {
+        return FIRST_VARIABLE + static_cast<int>(index);
+    }
+
+    int32_t constant(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto it = constants.find(bits);
+        if (it != constants.end()) {
+            return it->second;
+        }
+        int32_t offset = static_cast<int32_t>(4 * loop.constants.size());
+        loop.constants.push_back(value);
+        constants.emplace(bits, offset);
+        return offset;
+    }
+
+    void statement(const Statement* stmt)
+    {
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            size_t index = variables.at(symbols.slot(assignment->getIdentifier().lexeme));
+            Operand value = operand(assignment->getExpression(), 0);
+            move(variable(index), value);
+            if (!assigned[index]) {
+                // mov byte [rdx + index], 1
+                code.push_back(0xC6);
+                code.push_back(0x82);
+                append32(static_cast<uint32_t>(index));
+                code.push_back(1);
+                assigned[index] = true;
+            }
+            return;
+        }
+        auto repeat = static_cast<const RepeatStatement*>(stmt);
+        size_t top = code.size();
+        for (const Statement* inner : repeat->getBody()) {
+            statement(inner);
+        }
+        loopUnless(repeat->getCondition(), top);
+    }
+
+    // Jumps back to `top` while `condition` is false, which for a float
+    // means zero and not NaN.
+    void loopUnless(const Expr* condition, size_t top)
+    {
+        condition = unwrap(condition);
+        auto binary = dynamic_cast<const BinaryExpr*>(condition);
+        Token::Type op = binary != nullptr ? binary->getOperator().type : Token::Type::ENDOFFILE;
+        if (op == Token::Type::LESS_THAN || op == Token::Type::LESS_EQUAL || op == Token::Type::GREATER_THAN
+            || op == Token::Type::GREATER_EQUAL || op == Token::Type::EQUAL || op == Token::Type::NOT_EQUAL) {
+            // Compare directly instead of making a 0/1 value. ucomiss sets
+            // ZF, PF and CF on NaN, so a "false" comparison always includes
+            // the unordered case, as it does in C++.
+            int left = inRegister(binary->getLeft(), 0);
+            int right = inRegister(binary->getRight(), 1);
+            switch (op) {
+            case Token::Type::LESS_THAN:
+                sse(0, UCOMISS, right, left);
+                jumpTo(BELOW_EQUAL, top);
+                break;
+            case Token::Type::LESS_EQUAL:
+                sse(0, UCOMISS, right, left);
+                jumpTo(BELOW, top);
+                break;
+            case Token::Type::GREATER_THAN:
+                sse(0, UCOMISS, left, right);
+                jumpTo(BELOW_EQUAL, top);
+                break;
+            case Token::Type::GREATER_EQUAL:
+                sse(0, UCOMISS, left, right);
+                jumpTo(BELOW, top);
+                break;
+            case Token::Type::EQUAL:
+                sse(0, UCOMISS, left, right);
+                jumpTo(NOT_EQUAL, top);
+                jumpTo(PARITY, top);
+                break;
+            default: {
+                sse(0, UCOMISS, left, right);
+                size_t unordered = jump(PARITY);
+                jumpTo(EQUAL, top);
+                patch(unordered);
+                break;
+            }
+            }
+            return;
+        }
+        int value = inRegister(condition, 0);
+        sseMemory(0, UCOMISS, value, RSI, constant(0.0f));
+        size_t unordered = jump(PARITY);
+        jumpTo(EQUAL, top);
+        patch(unordered);
+    }
+
+    static const Expr* unwrap(const Expr* e)
+    {
+        while (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+            e = grouping->getExpression();
+        }
+        return e;
+    }
+
+    // `e` as an operand: a variable's register or a pooled constant as they
+    // are, anything else computed into temporary `target`.
+    Operand operand(const Expr* e, int target)
+    {
+        e = unwrap(e);
+        if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+            return Operand { false, variableRegister(variable), 0 };
+        }
+        float value;
+        if (decode(e, value)) {
+            return Operand { true, 0, constant(value) };
+        }
+        evaluate(e, target);
+        return Operand { false, target, 0 };
+    }
+
+    // `e` in a register, using temporary `target` unless it is a variable.
+    int inRegister(const Expr* e, int target)
+    {
+        Operand value = operand(e, target);
+        if (value.memory) {
+            move(target, value);
+            return target;
+        }
+        return value.reg;
+    }
+
+    // Computes `e` into temporary `target`, evaluating operands left to
+    // right like BinaryExpr::eval() so the same division by zero is found
+    // first.
+    void evaluate(const Expr* e, int target)
+    {
+        if (target + 1 >= TEMPORARIES) {
+            throw Unsupported();
+        }
+        e = unwrap(e);
+        auto binary = dynamic_cast<const BinaryExpr*>(e);
+        if (binary == nullptr) {
+            throw Unsupported();
+        }
+        move(target, operand(binary->getLeft(), target));
+        Operand right = operand(binary->getRight(), target + 1);
+        const Token& op = binary->getOperator();
+        switch (op.type) {
+        case Token::Type::PLUS:
+            arithmetic(ADDSS, target, right);
+            break;
+        case Token::Type::MINUS:
+            arithmetic(SUBSS, target, right);
+            break;
+        case Token::Type::MULTIPLY:
+            arithmetic(MULSS, target, right);
+            break;
+        case Token::Type::DIVIDE: {
+            size_t site = failure("Division by zero at operator '" + string(op.lexeme) + "' at line " + to_string(op.start_line) + ", column " + to_string(op.start_column));
+            if (right.memory) {
+                if (loop.constants[right.offset / 4] == 0) {
+                    failures[site].push_back(jump());
+                }
+            } else {
+                sseMemory(0, UCOMISS, right.reg, RSI, constant(0.0f));
+                size_t unordered = jump(PARITY);
+                failures[site].push_back(jump(EQUAL));
+                patch(unordered);
+            }
+            arithmetic(DIVSS, target, right);
+            break;
+        }
+        case Token::Type::LESS_THAN:
+            compare(CMP_LT, target, right, false);
+            break;
+        case Token::Type::LESS_EQUAL:
+            compare(CMP_LE, target, right, false);
+            break;
+        case Token::Type::GREATER_THAN:
+            compare(CMP_LT, target, right, true);
+            break;
+        case Token::Type::GREATER_EQUAL:
+            compare(CMP_LE, target, right, true);
+            break;
+        case Token::Type::EQUAL:
+            compare(CMP_EQ, target, right, false);
+            break;
+        case Token::Type::NOT_EQUAL:
+            compare(CMP_NEQ, target, right, false);
+            break;
+        default:
+            throw Unsupported();
+        }
+    }
+
+    // target = (target <predicate> right) ? 1 : 0, or with the operands
+    // swapped. cmpss gives an all-ones mask; masking 1.0f with it gives the
+    // value.
+    void compare(uint8_t predicate, int target, Operand right, bool swapped)
+    {
+        int scratch = target + 1;
+        if (swapped) {
+            move(scratch, right);
+            sse(0xF3, CMPSS, scratch, target);
+            code.push_back(predicate);
+            sse(0, MOVAPS, target, scratch);
+        } else {
+            arithmetic(CMPSS, target, right);
+            code.push_back(predicate);
+        }
+        sseMemory(0xF3, MOVSS, scratch, RSI, constant(1.0f));
+        sse(0, ANDPS, target, scratch);
+    }
+
+    int variableRegister(const VariableExpr* e)
+    {
+        size_t index = variables.at(symbols.slot(e->getIdentifier().lexeme));
+        if (!assigned[index]) {
+            loop.neededOnEntry[index] = 1;
+        }
+        return variable(index);
+    }
+
+    static bool decode(const Expr* e, float& value)
+    {
+        if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+            value = constant->getValue();
+            return true;
+        }
+        if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+            SymbolRegistry noSymbols;
+            try {
+                value = number->eval(noSymbols);
+                return true;
+            } catch (const std::exception&) {
+                // Left to the interpreter to throw.
+                throw Unsupported();
+            }
+        }
+        if (dynamic_cast<const LiteralExpr*>(e)) {
+            throw Unsupported();
+        }
+        return false;
+    }
+
+    size_t failure(std::string message)
+    {
+        loop.messages.push_back(std::move(message));
+        failures.emplace_back();
+        return failures.size() - 1;
+    }
+
+    void storeVariables()
+    {
+        for (size_t i = 0; i < loop.slots.size(); i++) {
+            sseMemory(0xF3, MOVSS_STORE, variable(i), RDI, static_cast<int32_t>(4 * i));
+        }
+    }
+
+    void move(int target, Operand source)
+    {
+        if (source.memory) {
+            sseMemory(0xF3, MOVSS, target, RSI, source.offset);
+        } else if (source.reg != target) {
+            sse(0, MOVAPS, target, source.reg);
+        }
+    }
+
+    void arithmetic(uint8_t opcode, int target, Operand source)
+    {
+        if (source.memory) {
+            sseMemory(0xF3, opcode, target, RSI, source.offset);
+        } else {
+            sse(0xF3, opcode, target, source.reg);
+        }
+    }
+
+    // <prefix> [REX] 0F <opcode> with a register-direct ModRM.
+    void sse(uint8_t prefix, uint8_t opcode, int reg, int rm)
+    {
+        if (prefix != 0) {
+            code.push_back(prefix);
+        }
+        uint8_t rex = 0x40 | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+        if (rex != 0x40) {
+            code.push_back(rex);
+        }
+        code.push_back(0x0F);
+        code.push_back(opcode);
+        code.push_back(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    // <prefix> [REX] 0F <opcode> with a [base + disp32] operand.
+    void sseMemory(uint8_t prefix, uint8_t opcode, int reg, int base, int32_t offset)
+    {
+        if (prefix != 0) {
+            code.push_back(prefix);
+        }
+        if (reg & 8) {
+            code.push_back(0x44);
+        }
+        code.push_back(0x0F);
+        code.push_back(opcode);
+        code.push_back(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | base));
+        append32(static_cast<uint32_t>(offset));
+    }
+
+    void append32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++) {
+            code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    // Emits a jump with its target left to patch(); returns its position.
+    size_t jump(int condition = -1)
+    {
+        if (condition < 0) {
+            code.push_back(0xE9);
+        } else {
+            code.push_back(0x0F);
+            code.push_back(static_cast<uint8_t>(0x80 | condition));
+        }
+        append32(0);
+        return code.size() - 4;
+    }
+
+    void jumpTo(int condition, size_t target)
+    {
+        size_t at = jump(condition);
+        setTarget(at, target);
+    }
+
+    // Points the jump at `at` to the next instruction.
+    void patch(size_t at)
+    {
+        setTarget(at, code.size());
+    }
+
+    void setTarget(size_t at, size_t target)
+    {
+        uint32_t relative = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &relative, sizeof(relative));
+    }
+};
+
+} // namespace
+
+bool LoopJit::isSupported()
+{
+    return true;
+}
+
+#else
+
+bool LoopJit::isSupported()
+{
+    return false;
+}
+
+#endif // TINY_JIT
+
+std::vector<Statement*> LoopJit::compile(const std::vector<Statement*>& program)
+{
+    std::vector<Statement*> result;
+    for (Statement* stmt : program) {
+        result.push_back(statement(stmt));
+    }
+    return result;
+}
+
+Statement* LoopJit::statement(Statement* stmt)
+{
+    if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+#ifdef TINY_JIT
+        auto loop = std::make_unique<NativeLoop>();
+        try {
+            std::vector<uint8_t> code = X86LoopCompiler(symbols, *loop).compile(repeat);
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t size = (code.size() + page - 1) / page * page;
+            void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory != MAP_FAILED) {
+                std::memcpy(memory, code.data(), code.size());
+                if (mprotect(memory, size, PROT_READ | PROT_EXEC) == 0) {
+                    loop->code = memory;
+                    loop->codeSize = size;
+                    loop->entry = reinterpret_cast<NativeLoop::Entry>(memory);
+                    loops.push_back(std::move(loop));
+                    return arena.make<NativeLoopStatement>(repeat, loops.back().get());
+                }
+                munmap(memory, size);
+            }
+        } catch (const Unsupported&) {
+        }
+#endif
+        bool changed = false;
+        ArenaList<Statement*> body = statements(repeat->getBody(), changed);
+        return changed ? arena.make<RepeatStatement>(body, repeat->getCondition()) : stmt;
+    }
+    if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+        bool changed = false;
+        ArenaList<Statement*> thenBranch = statements(ifStmt->getThenBranch(), changed);
+        ArenaList<Statement*> elseBranch = statements(ifStmt->getElseBranch(), changed);
+        return changed ? arena.make<IfStatement>(ifStmt->getCondition(), thenBranch, elseBranch) : stmt;
+    }
+    return stmt;
+}
+
+ArenaList<Statement*> LoopJit::statements(const ArenaList<Statement*>& stmts, bool& changed)
+{
+    std::vector<Statement*> result;
+    bool listChanged = false;
+    for (Statement* stmt : stmts) {
+        result.push_back(statement(stmt));
+        listChanged |= result.back() != stmt;
+    }
+    if (!listChanged) {
+        return stmts;
+    }
+    changed = true;
+    return ArenaList<Statement*>(arena, result);
+}
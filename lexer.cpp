@@ -1,190 +1,456 @@
 #include "lexer.h"
-#include <cctype>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include "parser.h"
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "scan.h"
 
-Lexer::Lexer(const std::string &source) : source(source), current(0), line(1), column(1)
+namespace {
+
+// ASCII-only character classes (what isdigit()/isalpha() give in the "C"
+// and UTF-8 locales), inlined instead of going through the ctype tables.
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isAlpha(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+inline bool isAlnum(char c) { return isDigit(c) || isAlpha(c); }
+inline bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+// Reserved words, classified by length and first character so that no
+// table has to be built or hashed at runtime.
+constexpr Token::Type keywordType(std::string_view text)
 {
-    reserved_map = {
-        {"if", Token::Type::IF},
-        {"else", Token::Type::ELSE},
-        {"repeat", Token::Type::REPEAT},
-        {"then", Token::Type::THEN},
-        {"end", Token::Type::END},
-        {"until", Token::Type::UNTIL},
-        {"write", Token::Type::WRITE},
-        {"read", Token::Type::READ},
-    };
+    switch (text.size()) {
+    case 2:
+        if (text == "if") return Token::Type::IF;
+        break;
+    case 3:
+        if (text == "end") return Token::Type::END;
+        break;
+    case 4:
+        switch (text[0]) {
+        case 'e': if (text == "else") return Token::Type::ELSE; break;
+        case 't': if (text == "then") return Token::Type::THEN; break;
+        case 'r': if (text == "read") return Token::Type::READ; break;
+        }
+        break;
+    case 5:
+        switch (text[0]) {
+        case 'u': if (text == "until") return Token::Type::UNTIL; break;
+        case 'w': if (text == "write") return Token::Type::WRITE; break;
+        }
+        break;
+    case 6:
+        if (text == "repeat") return Token::Type::REPEAT;
+        break;
+    }
+    return Token::Type::IDENTIFIER;
 }
 
-Token Lexer::nextToken()
+static_assert(keywordType("repeat") == Token::Type::REPEAT, "keyword table");
+static_assert(keywordType("then") == Token::Type::THEN, "keyword table");
+static_assert(keywordType("thenx") == Token::Type::IDENTIFIER, "keyword table");
+
+// Picks up to `chunks - 1` offsets that split the source into roughly
+// equal parts. Every split lands on a whitespace byte outside comments and
+// string literals, so it always falls between two tokens and lexing each part
+// on its own yields exactly the tokens of the whole.
+std::vector<size_t> findSplitPoints(std::string_view source, size_t chunks)
+{
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    std::vector<size_t> splits;
+
+    size_t pos = 0;
+    const char* nextBrace = nullptr;
+    const char* nextQuote = nullptr;
+    for (size_t k = 1; k < chunks && pos < source.size(); ) {
+        size_t target = std::max(pos, source.size() / chunks * k);
+
+        // Code runs from `pos` up to the next comment or literal.
+        if (nextBrace < begin + pos) nextBrace = scan::findByte(begin + pos, end, '{');
+        if (nextQuote < begin + pos) nextQuote = scan::findByte(begin + pos, end, '"');
+        const char* delimiter = std::min(nextBrace, nextQuote);
+
+        if (begin + target < delimiter) {
+            const char* split = begin + target;
+            while (split < delimiter && !isSpace(*split)) {
+                split++;
+            }
+            if (split < delimiter) {
+                splits.push_back(split - begin);
+                pos = split - begin + 1;
+                k++;
+                continue;
+            }
+        }
+        if (delimiter == end) {
+            break;
+        }
+        const char* close = scan::findByte(delimiter + 1, end, *delimiter == '{' ? '}' : '"');
+        pos = close == end ? source.size() : close + 1 - begin;
+    }
+    return splits;
+}
+
+} // namespace
+
+Lexer::Lexer(std::string_view source)
+    : source(source), current(0), tokenStart(0), positionOffset(0), line(1), column(1)
+    , input(nullptr), inputExhausted(true), diagnostics(&std::cerr), replay(nullptr)
+{
+}
+
+Lexer::Lexer(std::string_view source, size_t begin, SourceMap::Position position)
+    : Lexer(source, begin, position, std::cerr)
+{
+}
+
+Lexer::Lexer(std::string_view source, size_t begin, SourceMap::Position position, std::ostream& diagnostics)
+    : source(source), current(begin), tokenStart(begin), positionOffset(begin), line(position.line), column(position.column)
+    , input(nullptr), inputExhausted(true), diagnostics(&diagnostics), replay(nullptr)
+{
+}
+
+Lexer::Lexer(std::istream& input, size_t windowSize)
+    : current(0), tokenStart(0), positionOffset(0), line(1), column(1)
+    , input(&input), inputExhausted(false), diagnostics(&std::cerr), replay(nullptr)
 {
-    skipWhitespaceAndComments();
+    window.reserve(windowSize > 0 ? windowSize : DEFAULT_WINDOW_SIZE);
+}
 
-    if (isAtEnd())
-    {
-        return Token(Token::Type::ENDOFFILE, "", line, column, line, column);
+Lexer::Lexer(const TokenBuffer& tokens, size_t first, size_t last)
+    : source(tokens.getSource()), current(0), tokenStart(0)
+    , positionOffset(first < tokens.size() ? tokens.offset(first) : tokens.getSource().size())
+    , input(nullptr), inputExhausted(true), diagnostics(&std::cerr)
+    , replay(&tokens), replayNext(first), replayEnd(last)
+{
+    SourceMap::Position position = tokens.position(positionOffset);
+    line = position.line;
+    column = position.column;
+}
+
+Token Lexer::nextToken()
+{
+    if (replay) {
+        return replayToken();
     }
 
+    Token::Type type = scanToken();
+
+    syncPosition(tokenStart);
     int start_line = line;
     int start_column = column;
-    char c = source[current];
-
-    if (c == '+') { advance(); return Token(Token::Type::PLUS, "+", start_line, start_column, line, column); }
-    if (c == '-') { advance(); return Token(Token::Type::MINUS, "-", start_line, start_column, line, column); }
-    if (c == '*') { advance(); return Token(Token::Type::MULTIPLY, "*", start_line, start_column, line, column); }
-    if (c == '/') { advance(); return Token(Token::Type::DIVIDE, "/", start_line, start_column, line, column); }
-    if (c == '=') { advance(); return Token(Token::Type::EQUAL, "=", start_line, start_column, line, column); }
-    if (c == '(') { advance(); return Token(Token::Type::LEFT_PARENTHESIS, "(", start_line, start_column, line, column); }
-    if (c == ')') { advance(); return Token(Token::Type::RIGHT_PARENTHESIS, ")", start_line, start_column, line, column); }
-    if (c == ';') { advance(); return Token(Token::Type::SEMI_COLON, ";", start_line, start_column, line, column); }
-    if (c == ',') { advance(); return Token(Token::Type::COMMA, ",", start_line, start_column, line, column); }
-
-    if (c == '<') {
-        advance();
-        if (match('='))
-        {
-            return Token(Token::Type::LESS_EQUAL, "<=", start_line, start_column, line, column);
-        }
-        return Token(Token::Type::LESS_THAN, "<", start_line, start_column, line, column);
+    syncPosition(current);
+
+    std::string_view lexeme = source.substr(tokenStart, current - tokenStart);
+    if (type == Token::Type::LITERAL) {
+        lexeme = lexeme.substr(1, lexeme.size() - 2);
     }
-    if (c == '>') {
-        advance();
-        if (match('='))
-        {
-            return Token(Token::Type::GREATER_EQUAL, ">=", start_line, start_column, line, column);
+    if (input) {
+        // The window is about to be reused; give the token stable text.
+        std::string_view spelling = Token::getSpelling(type);
+        if (!spelling.empty() || type == Token::Type::ENDOFFILE) {
+            lexeme = spelling;
+        } else {
+            lexeme = *streamedLexemes.emplace(lexeme).first;
         }
-        return Token(Token::Type::GREATER_THAN, ">", start_line, start_column, line, column);
     }
-    if (c == '!') {
-        advance();
-        if (match('='))
-        {
-            return Token(Token::Type::NOT_EQUAL, "!=", start_line, start_column, line, column);
-        }
-        std::cerr << "Error(" << start_line << ":" << start_column << "): Unexpected character: !" << std::endl;
-        return nextToken();
+    return Token(type, lexeme, start_line, start_column, line, column);
+}
+
+// The replayed token carries the same lexeme and positions nextToken()
+// gave it when lexing; past `replayEnd` it is ENDOFFILE, like at the end
+// of the source.
+Token Lexer::replayToken()
+{
+    if (replayNext >= replayEnd) {
+        size_t end = replayEnd < replay->size() ? replay->offset(replayEnd) : source.size();
+        syncPosition(end);
+        return Token(Token::Type::ENDOFFILE, source.substr(end, 0), line, column, line, column);
     }
-    if (c == ':') {
-        advance();
-        if (match('='))
-        {
-            return Token(Token::Type::ASSIGNMENT, ":=", start_line, start_column, line, column);
-        }
-        std::cerr << "Error(" << start_line << ":" << start_column << "): Unexpected character: :" << std::endl;
-        return nextToken();
+
+    size_t i = replayNext++;
+    syncPosition(replay->offset(i));
+    int start_line = line;
+    int start_column = column;
+    syncPosition(replay->offset(i) + replay->length(i));
+    return Token(replay->type(i), replay->lexeme(i), start_line, start_column, line, column);
+}
+
+TokenBuffer Lexer::tokenizeAll()
+{
+    if (input) {
+        throw std::runtime_error("tokenizeAll() needs an in-memory source");
     }
+    if (source.size() > UINT32_MAX) {
+        throw std::runtime_error("Source too large for a token buffer (over 4 GiB)");
+    }
+
+    TokenBuffer tokens(source);
+    tokens.reserve(source.size() / 3 + 1);
+    scanAll(tokens);
+    tokens.finish();
+    return tokens;
+}
 
-    if (c == '"') {
-        return stringLiteral(start_line, start_column);
+TokenBuffer Lexer::tokenizeParallel(std::string_view source, unsigned threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
     }
+    // Below this a chunk isn't worth a thread.
+    const size_t minChunkSize = 256 * 1024;
+    size_t chunks = std::min<size_t>(threadCount, source.size() / minChunkSize);
+    if (chunks <= 1) {
+        return Lexer(source).tokenizeAll();
+    }
+    if (source.size() > UINT32_MAX) {
+        throw std::runtime_error("Source too large for a token buffer (over 4 GiB)");
+    }
+
+    SourceMap lines(source);
+    std::vector<size_t> bounds = findSplitPoints(source, chunks);
+    bounds.insert(bounds.begin(), 0);
+    bounds.push_back(source.size());
+    chunks = bounds.size() - 1;
 
-    if (isdigit(c)) {
-        return numberLiteral(start_line, start_column);
+    std::vector<TokenBuffer> parts(chunks, TokenBuffer(source));
+    std::vector<std::ostringstream> messages(chunks);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < chunks; i++) {
+        workers.emplace_back([&, i] {
+            Lexer lexer(source.substr(0, bounds[i + 1]), bounds[i], lines.position(bounds[i]), messages[i]);
+            parts[i].reserve((bounds[i + 1] - bounds[i]) / 3 + 1);
+            lexer.scanAll(parts[i]);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
     }
 
-    if (isalpha(c)) {
-        return identifierOrKeyword(start_line, start_column);
+    size_t total = 0;
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    TokenBuffer tokens(source);
+    tokens.reserve(total);
+    for (size_t i = 0; i < chunks; i++) {
+        // Each part ends with its own ENDOFFILE; only the last one is real.
+        size_t count = i + 1 < chunks ? parts[i].size() - 1 : parts[i].size();
+        tokens.append(parts[i], 0, count);
+        std::cerr << messages[i].str();
     }
+    tokens.finish(std::move(lines));
+    return tokens;
+}
+
+// Pushes every remaining token, including the final ENDOFFILE.
+void Lexer::scanAll(TokenBuffer& tokens)
+{
+    while (true) {
+        Token::Type type = scanToken();
+        tokens.push(type, tokenStart, current - tokenStart);
+        if (type == Token::Type::ENDOFFILE) {
+            break;
+        }
+    }
+}
+
+// Scans the next token, leaving `current` just past it and `tokenStart` at
+// its first byte. Bad characters are reported and skipped.
+Token::Type Lexer::scanToken()
+{
+    while (true) {
+        skipWhitespaceAndComments();
+        tokenStart = current;
+
+        if (atEnd())
+        {
+            return Token::Type::ENDOFFILE;
+        }
+
+        char c = source[current++];
+        switch (c) {
+        case '+': return Token::Type::PLUS;
+        case '-': return Token::Type::MINUS;
+        case '*': return Token::Type::MULTIPLY;
+        case '/': return Token::Type::DIVIDE;
+        case '=': return Token::Type::EQUAL;
+        case '(': return Token::Type::LEFT_PARENTHESIS;
+        case ')': return Token::Type::RIGHT_PARENTHESIS;
+        case ';': return Token::Type::SEMI_COLON;
+        case ',': return Token::Type::COMMA;
+        case '<': return match('=') ? Token::Type::LESS_EQUAL : Token::Type::LESS_THAN;
+        case '>': return match('=') ? Token::Type::GREATER_EQUAL : Token::Type::GREATER_THAN;
+        case '!':
+            if (match('=')) return Token::Type::NOT_EQUAL;
+            reportError(tokenStart, "Unexpected character: !");
+            continue;
+        case ':':
+            if (match('=')) return Token::Type::ASSIGNMENT;
+            reportError(tokenStart, "Unexpected character: :");
+            continue;
+        case '"':
+            return stringLiteral();
+        default:
+            break;
+        }
+
+        if (isDigit(c)) {
+            return numberLiteral();
+        }
+
+        if (isAlpha(c)) {
+            return identifierOrKeyword();
+        }
 
-    std::cerr << "Error(" << start_line << ":" << start_column << "): Unexpected character: " << c << std::endl;
-    advance();
-    return nextToken();
+        reportError(tokenStart, std::string("Unexpected character: ") + c);
+    }
 }
 
 bool Lexer::isAtEnd() const {
-    return current >= source.size();
+    if (replay) return replayNext >= replayEnd;
+    return current >= source.size() && inputExhausted;
 }
 
-void Lexer::advance() {
-    if (isAtEnd()) return;
+// Like isAtEnd(), but pulls more input when the window is used up.
+bool Lexer::atEnd() {
+    return current >= source.size() && !refill();
+}
 
-    if (source[current] == '\n') {
-        line++;
-        column = 1;
-    } else {
-        column++;
+// Discards the window up to `tokenStart` and appends more input after what
+// is left. Returns false once the stream has nothing more to give.
+bool Lexer::refill() {
+    if (inputExhausted) return false;
+
+    syncPosition(tokenStart);
+    window.erase(0, tokenStart);
+    current -= tokenStart;
+    positionOffset -= tokenStart;
+    tokenStart = 0;
+
+    size_t kept = window.size();
+    size_t room = window.capacity() - kept;
+    if (room == 0) {
+        // A single token fills the whole window.
+        room = window.capacity();
     }
-    current++;
+    window.resize(kept + room);
+    input->read(&window[kept], room);
+    window.resize(kept + input->gcount());
+    source = window;
+
+    if (window.size() == kept) {
+        inputExhausted = true;
+        return false;
+    }
+    return true;
 }
 
-char Lexer::peek() const
-{
-    if (isAtEnd()) return '\0';
-    return source[current];
+// Moves the position cursor forward to `offset`, counting newlines in bulk.
+void Lexer::syncPosition(size_t offset) {
+    if (offset <= positionOffset) return;
+
+    const char* begin = source.data() + positionOffset;
+    const char* end = source.data() + offset;
+    size_t newlines = scan::countByte(begin, end, '\n');
+    if (newlines == 0) {
+        column += static_cast<int>(end - begin);
+    } else {
+        const char* lastNewline = end - 1;
+        while (*lastNewline != '\n') {
+            lastNewline--;
+        }
+        line += static_cast<int>(newlines);
+        column = static_cast<int>(end - lastNewline);
+    }
+    positionOffset = offset;
 }
 
-char Lexer::peekNext() const {
-    if (current + 1 >= source.size()) return '\0';
-    return source[current + 1];
+void Lexer::reportError(size_t offset, const std::string& message) {
+    syncPosition(offset);
+    *diagnostics << "Error(" << line << ":" << column << "): " << message << std::endl;
 }
 
 bool Lexer::match(char expected) {
-    if (isAtEnd()) return false;
+    if (atEnd()) return false;
     if (source[current] != expected) return false;
-    advance();
+    current++;
     return true;
 }
 
 void Lexer::skipWhitespaceAndComments() {
-    while (!isAtEnd()) {
-        char c = peek();
-        if (isspace(c)) {
-            advance();
-        } else if (c == '{') {
-            advance();
-            while (!isAtEnd() && peek() != '}') {
-                advance();
+    while (true) {
+        if (current >= source.size()) {
+            tokenStart = current;
+            if (!refill()) return;
+        }
+
+        const char* begin = source.data();
+        const char* end = begin + source.size();
+        const char* here = begin + current;
+        if (isSpace(*here)) {
+            // Single separators are the common case; only long runs are
+            // worth a vector scan.
+            if (here + 1 < end && isSpace(here[1])) {
+                current = scan::skipWhitespace(here + 2, end) - begin;
+            } else {
+                current++;
+            }
+        } else if (*here == '{') {
+            current++;
+            while (true) {
+                current = scan::findByte(source.data() + current, source.data() + source.size(), '}') - source.data();
+                if (current < source.size()) break;
+                tokenStart = current;
+                if (!refill()) break;
             }
-            if (isAtEnd()) {
-                std::cerr << "Warning: Unterminated comment starting near line " << line << std::endl;
+            if (current >= source.size()) {
+                syncPosition(current);
+                *diagnostics << "Warning: Unterminated comment starting near line " << line << std::endl;
             } else {
-                advance();
+                current++;
             }
         } else {
-            break;
+            return;
         }
     }
 }
 
-Token Lexer::stringLiteral(int start_line, int start_column) {
-    advance();
-    std::string value;
-    while (!isAtEnd() && peek() != '"') {
-        value += peek();
-        advance();
+Token::Type Lexer::stringLiteral() {
+    while (true) {
+        current = scan::findByte(source.data() + current, source.data() + source.size(), '"') - source.data();
+        if (current < source.size() || !refill()) break;
     }
 
-    if (isAtEnd()) {
-        std::cerr << "Error(" << start_line << ":" << start_column << "): Unterminated string literal." << std::endl;
-        return Token(Token::Type::ENDOFFILE, "", line, column, line, column);
+    if (current >= source.size()) {
+        reportError(tokenStart, "Unterminated string literal.");
+        tokenStart = current;
+        return Token::Type::ENDOFFILE;
     }
 
-    advance();
-    return Token(Token::Type::LITERAL, value, start_line, start_column, line, column);
+    current++;
+    return Token::Type::LITERAL;
 }
 
-Token Lexer::numberLiteral(int start_line, int start_column) {
-    std::string numberStr;
-    while (!isAtEnd() && isdigit(peek())) {
-        numberStr += peek();
-        advance();
+Token::Type Lexer::numberLiteral() {
+    while (true) {
+        while (current < source.size() && isDigit(source[current])) {
+            current++;
+        }
+        if (current < source.size() || !refill()) break;
     }
-    return Token(Token::Type::NUMBER, numberStr, start_line, start_column, line, column);
+    return Token::Type::NUMBER;
 }
 
-Token Lexer::identifierOrKeyword(int start_line, int start_column) {
-    std::string text;
-    while (!isAtEnd() && (isalnum(peek()) || peek() == '_')) {
-        text += peek();
-        advance();
-    }
-
-    Token::Type type = Token::Type::IDENTIFIER;
-    auto it = reserved_map.find(text);
-    if (it != reserved_map.end()) {
-        type = it->second;
+Token::Type Lexer::identifierOrKeyword() {
+    while (true) {
+        while (current < source.size() && (isAlnum(source[current]) || source[current] == '_')) {
+            current++;
+        }
+        if (current < source.size() || !refill()) break;
     }
-    return Token(type, text, start_line, start_column, line, column);
+    return keywordType(source.substr(tokenStart, current - tokenStart));
 }
-
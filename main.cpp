@@ -1,60 +1,292 @@
+#include "artifact.h"
+#include "cBackend.h"
+#include "inputBuffer.h"
 #include "interpreter.h"
 #include "lexer.h"
+#include "mappedFile.h"
+#include "optimizer.h"
+#include "outputSink.h"
 #include "parser.h"
 #include <cctype>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace std;
 
-int main(int argc, char** argv)
+static bool readWholeFile(const char* path, string& text)
 {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <source_file>" << std::endl;
-        return 1;
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        return false;
     }
+    ostringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+}
 
-    ifstream file(argv[1]);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+static void reportCheck(const ParseResult& parsed, double milliseconds)
+{
+    if (parsed.isError()) {
+        std::cerr << "Parser errors:\n";
+        for (const auto& error : parsed.errors) {
+            std::cerr << error << std::endl;
+        }
+    }
+    std::cout << (parsed.isError() ? "Check failed: " : "Check passed: ") << parsed.statements.size()
+              << " top-level statements, " << milliseconds << " ms" << std::endl;
+}
+
+// Parses `path`, then re-checks it whenever its modification time changes.
+// Only the part of the program around each change is parsed again.
+static int watch(const char* path)
+{
+    string text;
+    if (!readWholeFile(path, text)) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
         return 1;
     }
-    std::string source((std::istreambuf_iterator<char>(file)),
-        std::istreambuf_iterator<char>());
-    file.close();
 
+    auto start = chrono::steady_clock::now();
+    ParseResult parsed = Parser::parseText(text);
+    reportCheck(parsed, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
 
-    Lexer lexer(source);
-    Parser parser(lexer);
+    struct stat info;
+    timespec lastModified = stat(path, &info) == 0 ? info.st_mtim : timespec {};
+    while (true) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        if (stat(path, &info) != 0 || (info.st_mtim.tv_sec == lastModified.tv_sec && info.st_mtim.tv_nsec == lastModified.tv_nsec)) {
+            continue;
+        }
+        lastModified = info.st_mtim;
+        if (!readWholeFile(path, text) || text == *parsed.source) {
+            continue;
+        }
 
-    std::ostringstream outputStream;
-    Interpreter interpreter(std::cin, outputStream);
+        start = chrono::steady_clock::now();
+        TextEdit edit = TextEdit::between(*parsed.source, text);
+        parsed = Parser::reparse(std::move(parsed), edit);
+        reportCheck(parsed, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool streamSource = false;
+    bool watchSource = false;
+    bool parallelParse = false;
+    string compilePath;
+    string cacheDirectory;
+    string emitCPath;
+    string nativePath;
+    Interpreter::Engine engine = Interpreter::Engine::TreeWalk;
+    int optimizationLevel = 1;
+    bool optimizationStats = false;
+    bool integerArithmetic = false;
+    const char* sourcePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--stream") {
+            streamSource = true;
+        } else if (arg == "--watch") {
+            watchSource = true;
+        } else if (arg == "--parallel") {
+            parallelParse = true;
+        } else if (arg.rfind("--compile=", 0) == 0 && arg.size() > 10) {
+            compilePath = arg.substr(10);
+        } else if (arg.rfind("--emit-c=", 0) == 0 && arg.size() > 9) {
+            emitCPath = arg.substr(9);
+        } else if (arg.rfind("--native=", 0) == 0 && arg.size() > 9) {
+            nativePath = arg.substr(9);
+        } else if (arg == "--cache") {
+            cacheDirectory = ".tinycache";
+        } else if (arg.rfind("--cache=", 0) == 0 && arg.size() > 8) {
+            cacheDirectory = arg.substr(8);
+        } else if (arg == "--engine=tree") {
+            engine = Interpreter::Engine::TreeWalk;
+        } else if (arg == "--engine=flat") {
+            engine = Interpreter::Engine::Flat;
+        } else if (arg == "--engine=vm") {
+            engine = Interpreter::Engine::Vm;
+        } else if (arg == "--engine=closure") {
+            engine = Interpreter::Engine::Closure;
+        } else if (arg == "--engine=jit") {
+            engine = Interpreter::Engine::Jit;
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            optimizationLevel = arg[2] - '0';
+        } else if (arg == "--opt-stats") {
+            optimizationStats = true;
+        } else if (arg == "--int64") {
+            integerArithmetic = true;
+        } else if (sourcePath == nullptr && arg.rfind("-", 0) != 0) {
+            sourcePath = argv[i];
+        } else {
+            sourcePath = nullptr;
+            break;
+        }
+    }
+    bool compiling = !compilePath.empty() || !cacheDirectory.empty();
+    bool emitting = !emitCPath.empty() || !nativePath.empty();
+    if (sourcePath == nullptr || streamSource + watchSource + parallelParse + compiling + emitting > 1
+        || (integerArithmetic && (engine != Interpreter::Engine::Vm || emitting))) {
+        std::cerr << "Usage: " << argv[0] << " [--stream | --parallel | --watch | [--cache[=dir]] [--compile=out.tlc] | [--emit-c=out.c] [--native=out]] [-O0 | -O1 | -O2] [--opt-stats] [--engine=tree|flat|closure|vm [--int64]|jit] <source_file | program.tlc>" << std::endl;
+        return 1;
+    }
+    if (watchSource) {
+        return watch(sourcePath);
+    }
+
+    // Tokens and AST nodes point straight into the mapping, so `file` has to
+    // stay open until the program has finished running. With --stream the
+    // source is read through the lexer's window instead and never held in
+    // memory as a whole. With --parallel the parser lexes the mapping itself.
+    // A compiled program (.tlc) is not lexed at all: its statements are
+    // rebuilt from the artifact and view the string pool in `loaded`.
+    MappedFile file;
+    ProgramArtifact::Loaded loaded;
+    bool precompiled = false;
+    ifstream stream;
+    unique_ptr<Lexer> lexer;
+    if (streamSource) {
+        stream.open(sourcePath, ios::binary);
+        if (stream.is_open()) {
+            lexer = make_unique<Lexer>(stream);
+        }
+    } else if (file.open(sourcePath) && !parallelParse) {
+        lexer = make_unique<Lexer>(file.view());
+    }
+    if (!lexer && !(parallelParse && file.isOpen())) {
+        std::cerr << "Error: Could not open file " << sourcePath << std::endl;
+        return 1;
+    }
+    if (!streamSource && ProgramArtifact::isArtifact(file.view())) {
+        try {
+            loaded = ProgramArtifact::load(file.view());
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << sourcePath << ": " << e.what() << std::endl;
+            return 1;
+        }
+        if (!compilePath.empty()) {
+            std::cerr << "Error: " << sourcePath << " is already compiled" << std::endl;
+            return 1;
+        }
+        precompiled = true;
+    } else if (!cacheDirectory.empty()) {
+        precompiled = ProgramCache(cacheDirectory).load(file.view(), loaded);
+    }
+
+    // Program output streams to stdout through its own buffer rather than
+    // std::cout, which is only used for the headers around it. Input is
+    // read from stdin in large blocks, or mapped when it is a file, and
+    // tied to the output on a terminal so a prompt shows before `read`
+    // waits.
+    OutputSink sink(STDOUT_FILENO);
+    std::ostream outputStream(&sink);
+    InputBuffer source(STDIN_FILENO);
+    std::istream inputStream(&source);
+    inputStream.tie(isatty(STDIN_FILENO) ? &outputStream : nullptr);
+    Interpreter interpreter(inputStream, outputStream);
+    interpreter.setEngine(engine);
+    interpreter.setIntegerArithmetic(integerArithmetic);
 
     try {
-        vector<Statement*> program = parser.parse();
-        if (parser.getErrors().size() > 0) {
+        ParseResult parsed;
+        if (precompiled) {
+            std::cerr << loaded.diagnostics;
+            parsed.arena = make_unique<Arena>();
+            parsed.statements = loaded.program.toStatements(*parsed.arena);
+        } else if (compiling) {
+            // Lexer diagnostics are kept with the artifact and replayed
+            // whenever it is loaded.
+            std::ostringstream diagnostics;
+            lexer->setDiagnostics(diagnostics);
+            parsed = Parser(*lexer).parseProgram();
+            std::cerr << diagnostics.str();
+            if (!parsed.isError()) {
+                FlatProgram program = FlatProgram::flatten(parsed.statements);
+                if (!cacheDirectory.empty()) {
+                    ProgramCache(cacheDirectory).store(file.view(), program, diagnostics.str());
+                }
+                if (!compilePath.empty()) {
+                    string bytes = ProgramArtifact::serialize(program, file.view(), diagnostics.str());
+                    ofstream out(compilePath, ios::binary | ios::trunc);
+                    out.write(bytes.data(), bytes.size());
+                    out.close();
+                    if (!out) {
+                        std::cerr << "Error: Could not write file " << compilePath << std::endl;
+                        return 1;
+                    }
+                    return 0;
+                }
+            }
+        } else {
+            parsed = parallelParse ? Parser::parseParallel(file.view()) : Parser(*lexer).parseProgram();
+        }
+        const vector<Statement*>& program = parsed.statements;
+        if (parsed.isError()) {
             std::cerr << "Parser errors:\n";
-            for (const auto& error : parser.getErrors()) {
+            for (const auto& error : parsed.errors) {
                 std::cerr << error << std::endl;
             }
             return 1;
         }
 
+        // Artifacts hold the program as parsed, so this runs on every load.
+        if (!parsed.arena) {
+            parsed.arena = make_unique<Arena>();
+        }
+        Optimizer optimizer(*parsed.arena, optimizationLevel, integerArithmetic);
+        vector<Statement*> optimized = optimizer.optimize(program);
+        if (optimizationStats) {
+            const OptimizationStats& stats = optimizer.stats();
+            std::cerr << "Optimizer -O" << optimizationLevel << ": folded " << stats.foldedExpressions
+                      << ", hoisted " << stats.hoistedExpressions << ", reduced " << stats.reducedMultiplications
+                      << ", removed stores " << stats.removedStores << " (" << stats.removedNodes << " expression nodes)"
+                      << ", fused increments " << stats.fusedIncrements << ", accumulations " << stats.fusedAccumulations
+                      << ", loop exits " << stats.fusedLoopExits << std::endl;
+        }
+
+        if (emitting) {
+            string c = CBackend::emit(optimized);
+            if (!emitCPath.empty()) {
+                ofstream out(emitCPath, ios::binary | ios::trunc);
+                out << c;
+                out.close();
+                if (!out) {
+                    std::cerr << "Error: Could not write file " << emitCPath << std::endl;
+                    return 1;
+                }
+            }
+            string error;
+            if (!nativePath.empty() && !CBackend::compileNative(c, nativePath, error)) {
+                std::cerr << "Error: Could not build " << nativePath << ": " << error << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
         string output;
         for (auto& stmt : program) {
             output += stmt->toString();
         }
 
         cout << "Parsed Program:\n" << output << endl;
+        std::cout << "Interpreter Output:" << std::endl;
 
-        interpreter.interpret(program);
-
-        std::cout << "Interpreter Output:\n" << outputStream.str();
+        interpreter.interpret(optimized);
+        outputStream.flush();
     } catch (const std::exception& e) {
+        // Output written before the error is kept and goes out first.
+        outputStream.flush();
         std::cerr << "Error: " << e.what() << std::endl;
     }
 
@@ -0,0 +1,58 @@
+#include "mappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, info.st_size, MADV_SEQUENTIAL);
+            mapping = addr;
+            mappingSize = info.st_size;
+            ::close(fd);
+            opened = true;
+            return true;
+        }
+    }
+
+    // Not mappable: read it the slow way.
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        fallback.append(buffer, n);
+    }
+    ::close(fd);
+    if (n < 0) {
+        fallback.clear();
+        return false;
+    }
+    opened = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+        mappingSize = 0;
+    }
+    fallback.clear();
+    opened = false;
+}
@@ -0,0 +1,971 @@
+#include "optimizer.h"
+#include "typeInference.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Integers up to 2^24 are exact floats, and sums and products of them that
+// stay in that range are computed exactly.
+constexpr float EXACT_LIMIT = 16777216.0f;
+
+bool isExactInteger(float value)
+{
+    return std::trunc(value) == value && std::fabs(value) <= EXACT_LIMIT;
+}
+
+// A constant whose float is an exact integer, and the integer it stands for
+// if it keeps one.
+const ConstantExpr* integerConstant(const Expr* e)
+{
+    auto constant = dynamic_cast<const ConstantExpr*>(e);
+    if (!constant || !isExactInteger(constant->getValue())) {
+        return nullptr;
+    }
+    return !constant->isInteger() || constant->getInteger() == static_cast<int64_t>(constant->getValue()) ? constant : nullptr;
+}
+
+// `left op right` as the int64 path computes it; false where that goes on
+// in float instead: on overflow, for a product float makes -0, and for
+// division, which is always a float.
+bool integerArithmetic(Token::Type op, int64_t left, int64_t right, int64_t& result)
+{
+    switch (op) {
+    case Token::Type::PLUS: return !__builtin_add_overflow(left, right, &result);
+    case Token::Type::MINUS: return !__builtin_sub_overflow(left, right, &result);
+    case Token::Type::MULTIPLY: return !__builtin_mul_overflow(left, right, &result) && (result != 0 || (left | right) >= 0);
+    case Token::Type::LESS_THAN: result = left < right; return true;
+    case Token::Type::LESS_EQUAL: result = left <= right; return true;
+    case Token::Type::GREATER_THAN: result = left > right; return true;
+    case Token::Type::GREATER_EQUAL: result = left >= right; return true;
+    case Token::Type::EQUAL: result = left == right; return true;
+    case Token::Type::NOT_EQUAL: result = left != right; return true;
+    default: return false;
+    }
+}
+
+// Whether the int64 path may go on in float at `binary`, an integer +, -
+// or *; `types` is null when not optimizing for it.
+bool mayDeoptimize(const BinaryExpr* binary, const TypeInference* types)
+{
+    switch (binary->getOperator().type) {
+    case Token::Type::PLUS:
+    case Token::Type::MINUS:
+    case Token::Type::MULTIPLY:
+        return types && types->isInteger(binary);
+    default:
+        return false;
+    }
+}
+
+bool isVariable(const Expr* e, std::string_view name)
+{
+    auto variable = dynamic_cast<const VariableExpr*>(e);
+    return variable && variable->getIdentifier().lexeme == name;
+}
+
+// Counts, per variable, the assignments and reads in `stmt`.
+void collectDefinitions(const Statement* stmt, std::map<std::string_view, int>& definitions)
+{
+    if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+        definitions[assignment->getIdentifier().lexeme]++;
+    } else if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+        for (const Token& identifier : read->getIdentifiers()) {
+            definitions[identifier.lexeme]++;
+        }
+    } else if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+        for (const Statement* inner : ifStmt->getThenBranch()) {
+            collectDefinitions(inner, definitions);
+        }
+        for (const Statement* inner : ifStmt->getElseBranch()) {
+            collectDefinitions(inner, definitions);
+        }
+    } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+        for (const Statement* inner : repeat->getBody()) {
+            collectDefinitions(inner, definitions);
+        }
+    }
+}
+
+// Whether `e` gives the same value on every iteration of a loop that defines
+// `definitions`, and cannot throw (or deoptimize, see mayDeoptimize()) when
+// computed before it. Sets `hasVariable` if it reads a variable.
+bool isInvariant(const Expr* e, const std::map<std::string_view, int>& definitions, const std::set<std::string_view>& entry, const TypeInference* types, bool& hasVariable)
+{
+    if (dynamic_cast<const ConstantExpr*>(e)) {
+        return true;
+    }
+    if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+        std::string_view name = variable->getIdentifier().lexeme;
+        hasVariable = true;
+        return definitions.count(name) == 0 && entry.count(name) != 0;
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+        switch (binary->getOperator().type) {
+        case Token::Type::PLUS:
+        case Token::Type::MINUS:
+        case Token::Type::MULTIPLY:
+        case Token::Type::LESS_THAN:
+        case Token::Type::LESS_EQUAL:
+        case Token::Type::GREATER_THAN:
+        case Token::Type::GREATER_EQUAL:
+        case Token::Type::EQUAL:
+        case Token::Type::NOT_EQUAL:
+            break;
+        case Token::Type::DIVIDE: {
+            auto divisor = dynamic_cast<const ConstantExpr*>(binary->getRight());
+            if (!divisor || divisor->getValue() == 0) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        return !mayDeoptimize(binary, types) && isInvariant(binary->getLeft(), definitions, entry, types, hasVariable)
+            && isInvariant(binary->getRight(), definitions, entry, types, hasVariable);
+    }
+    return false;
+}
+
+// Whether evaluating `e` cannot throw (or deoptimize, see mayDeoptimize())
+// when the variables in `assigned` are the only ones certainly defined.
+bool cannotThrow(const Expr* e, const std::set<std::string_view>& assigned, const TypeInference* types)
+{
+    if (dynamic_cast<const ConstantExpr*>(e)) {
+        return true;
+    }
+    if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+        return assigned.count(variable->getIdentifier().lexeme) != 0;
+    }
+    if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+        return cannotThrow(grouping->getExpression(), assigned, types);
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+        switch (binary->getOperator().type) {
+        case Token::Type::PLUS:
+        case Token::Type::MINUS:
+        case Token::Type::MULTIPLY:
+        case Token::Type::LESS_THAN:
+        case Token::Type::LESS_EQUAL:
+        case Token::Type::GREATER_THAN:
+        case Token::Type::GREATER_EQUAL:
+        case Token::Type::EQUAL:
+        case Token::Type::NOT_EQUAL:
+            break;
+        case Token::Type::DIVIDE: {
+            auto divisor = dynamic_cast<const ConstantExpr*>(binary->getRight());
+            if (!divisor || divisor->getValue() == 0) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        return !mayDeoptimize(binary, types) && cannotThrow(binary->getLeft(), assigned, types)
+            && cannotThrow(binary->getRight(), assigned, types);
+    }
+    return false;
+}
+
+// Adds the variables `e` reads to `uses`.
+void collectUses(const Expr* e, std::set<std::string_view>& uses)
+{
+    if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+        uses.insert(variable->getIdentifier().lexeme);
+    } else if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+        collectUses(grouping->getExpression(), uses);
+    } else if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+        collectUses(binary->getLeft(), uses);
+        collectUses(binary->getRight(), uses);
+    }
+}
+
+// Adds the variables `stmt` and the statements in it read to `uses`.
+void collectUses(const Statement* stmt, std::set<std::string_view>& uses)
+{
+    if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+        collectUses(assignment->getExpression(), uses);
+    } else if (auto write = dynamic_cast<const WriteStatement*>(stmt)) {
+        for (const Expr* operand : write->getOperands()) {
+            collectUses(operand, uses);
+        }
+    } else if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+        collectUses(ifStmt->getCondition(), uses);
+        for (const Statement* inner : ifStmt->getThenBranch()) {
+            collectUses(inner, uses);
+        }
+        for (const Statement* inner : ifStmt->getElseBranch()) {
+            collectUses(inner, uses);
+        }
+    } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+        for (const Statement* inner : repeat->getBody()) {
+            collectUses(inner, uses);
+        }
+        collectUses(repeat->getCondition(), uses);
+    }
+}
+
+size_t countNodes(const Expr* e)
+{
+    if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+        return 1 + countNodes(grouping->getExpression());
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+        return 1 + countNodes(binary->getLeft()) + countNodes(binary->getRight());
+    }
+    return 1;
+}
+
+// A key equal for invariant expressions that compute the same value.
+std::string invariantKey(const Expr* e)
+{
+    if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+        if (constant->isInteger()) {
+            return "#i" + std::to_string(constant->getInteger());
+        }
+        float value = constant->getValue();
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        return "#" + std::to_string(bits);
+    }
+    if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+        return std::string(variable->getIdentifier().lexeme);
+    }
+    auto binary = static_cast<const BinaryExpr*>(e);
+    return "(" + invariantKey(binary->getLeft()) + " " + std::string(binary->getOperator().lexeme) + " " + invariantKey(binary->getRight()) + ")";
+}
+
+} // namespace
+
+std::vector<Statement*> Optimizer::optimize(const std::vector<Statement*>& program)
+{
+    if (level <= 0) {
+        return program;
+    }
+    std::vector<Statement*> result;
+    result.reserve(program.size());
+    for (Statement* stmt : program) {
+        result.push_back(statement(stmt));
+    }
+    if (integers) {
+        SymbolRegistry noSymbols;
+        types = TypeInference::infer(result, noSymbols);
+    }
+    if (level >= 2) {
+        Names assigned;
+        Constants known;
+        result = loops(result, assigned, known);
+    }
+    result = eliminateDeadStores(result);
+    for (Statement*& stmt : result) {
+        stmt = fuse(stmt);
+    }
+    return result;
+}
+
+Statement* Optimizer::statement(Statement* stmt)
+{
+    if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+        Expr* value = expr(assignment->getExpression());
+        if (value == assignment->getExpression()) {
+            return stmt;
+        }
+        return arena.make<AssignmentStatement>(assignment->getIdentifier(), value);
+    }
+    if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+        bool changed = false;
+        Expr* condition = expr(ifStmt->getCondition());
+        ArenaList<Statement*> thenBranch = statements(ifStmt->getThenBranch(), changed);
+        ArenaList<Statement*> elseBranch = statements(ifStmt->getElseBranch(), changed);
+        if (!changed && condition == ifStmt->getCondition()) {
+            return stmt;
+        }
+        return arena.make<IfStatement>(condition, thenBranch, elseBranch);
+    }
+    if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+        bool changed = false;
+        ArenaList<Statement*> body = statements(repeat->getBody(), changed);
+        Expr* condition = expr(repeat->getCondition());
+        if (!changed && condition == repeat->getCondition()) {
+            return stmt;
+        }
+        return arena.make<RepeatStatement>(body, condition);
+    }
+    if (auto write = dynamic_cast<WriteStatement*>(stmt)) {
+        bool changed = false;
+        std::vector<Expr*> operands;
+        for (Expr* operand : write->getOperands()) {
+            operands.push_back(expr(operand));
+            changed |= operands.back() != operand;
+        }
+        if (!changed) {
+            return stmt;
+        }
+        return arena.make<WriteStatement>(ArenaList<Expr*>(arena, operands));
+    }
+    // ReadStatement has no expressions.
+    return stmt;
+}
+
+ArenaList<Statement*> Optimizer::statements(const ArenaList<Statement*>& stmts, bool& changed)
+{
+    std::vector<Statement*> result;
+    bool listChanged = false;
+    for (Statement* stmt : stmts) {
+        result.push_back(statement(stmt));
+        listChanged |= result.back() != stmt;
+    }
+    if (!listChanged) {
+        return stmts;
+    }
+    changed = true;
+    return ArenaList<Statement*>(arena, result);
+}
+
+Expr* Optimizer::expr(Expr* e)
+{
+    if (auto binary = dynamic_cast<BinaryExpr*>(e)) {
+        Expr* left = expr(binary->getLeft());
+        Expr* right = expr(binary->getRight());
+        if (Expr* folded = fold(binary, left, right)) {
+            return folded;
+        }
+        if (left == binary->getLeft() && right == binary->getRight()) {
+            return e;
+        }
+        return makeBinaryExpr(arena, left, binary->getOperator(), right);
+    }
+    if (auto grouping = dynamic_cast<GroupingExpression*>(e)) {
+        Expr* inner = expr(grouping->getExpression());
+        if (dynamic_cast<LiteralExpr*>(inner)) {
+            return e;
+        }
+        return inner;
+    }
+    if (auto number = dynamic_cast<NumberExpr*>(e)) {
+        const Token& token = number->getToken();
+        if (token.type != Token::Type::NUMBER) {
+            return e;
+        }
+        // Out-of-range literals keep throwing from NumberExpr::eval(). One
+        // an int64_t holds also keeps its digits, since stof() rounds
+        // 16777217 to 2^24.
+        try {
+            float value = std::stof(std::string(token.lexeme));
+            int64_t digits;
+            const char* end = token.lexeme.data() + token.lexeme.size();
+            auto parsed = std::from_chars(token.lexeme.data(), end, digits);
+            if (parsed.ec == std::errc() && parsed.ptr == end) {
+                return arena.make<ConstantExpr>(value, digits);
+            }
+            return arena.make<ConstantExpr>(value);
+        } catch (const std::logic_error&) {
+            return e;
+        }
+    }
+    return e;
+}
+
+// The value of `binary` applied to `left` and `right` if both are constants
+// and evaluating it does not throw; otherwise nullptr. Integer operands give
+// an integer result where the int64 path has one.
+Expr* Optimizer::fold(BinaryExpr* binary, Expr* left, Expr* right)
+{
+    auto leftConstant = dynamic_cast<ConstantExpr*>(left);
+    auto rightConstant = dynamic_cast<ConstantExpr*>(right);
+    if (!leftConstant || !rightConstant) {
+        return nullptr;
+    }
+    BinaryExpr folded(left, binary->getOperator(), right);
+    SymbolRegistry noSymbols;
+    try {
+        float value = folded.eval(noSymbols);
+        Token::Type op = binary->getOperator().type;
+        int64_t integer;
+        if (leftConstant->isInteger() && rightConstant->isInteger()) {
+            // The float is still what float arithmetic gives: it is what the
+            // int64 path's fallback reads.
+            if (integerArithmetic(op, leftConstant->getInteger(), rightConstant->getInteger(), integer)) {
+                counts.foldedExpressions++;
+                return arena.make<ConstantExpr>(value, integer);
+            }
+            if (integers && op != Token::Type::DIVIDE) {
+                return nullptr;
+            }
+        }
+        counts.foldedExpressions++;
+        return arena.make<ConstantExpr>(value);
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+}
+
+// The name of a new temporary. `$` cannot start an identifier in source, so
+// it does not clash with the program's own variables.
+Token Optimizer::temporary()
+{
+    std::string name = "$t" + std::to_string(temporaries++);
+    char* text = static_cast<char*>(arena.allocate(name.size(), 1));
+    std::memcpy(text, name.data(), name.size());
+    return Token(Token::Type::IDENTIFIER, std::string_view(text, name.size()), 0, 0, 0, 0);
+}
+
+// `stmt` with every expression e in it for which replace(e) is not null
+// replaced, outermost first.
+template <typename Replace>
+Statement* Optimizer::rewrite(Statement* stmt, Replace& replace)
+{
+    auto list = [&](const ArenaList<Statement*>& stmts, bool& changed) {
+        std::vector<Statement*> result;
+        for (Statement* inner : stmts) {
+            result.push_back(rewrite(inner, replace));
+            changed |= result.back() != inner;
+        }
+        return changed ? ArenaList<Statement*>(arena, result) : stmts;
+    };
+    if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+        Expr* value = rewrite(assignment->getExpression(), replace);
+        return value == assignment->getExpression() ? stmt : arena.make<AssignmentStatement>(assignment->getIdentifier(), value);
+    }
+    if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+        bool thenChanged = false, elseChanged = false;
+        Expr* condition = rewrite(ifStmt->getCondition(), replace);
+        ArenaList<Statement*> thenBranch = list(ifStmt->getThenBranch(), thenChanged);
+        ArenaList<Statement*> elseBranch = list(ifStmt->getElseBranch(), elseChanged);
+        if (!thenChanged && !elseChanged && condition == ifStmt->getCondition()) {
+            return stmt;
+        }
+        return arena.make<IfStatement>(condition, thenBranch, elseBranch);
+    }
+    if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+        bool changed = false;
+        ArenaList<Statement*> body = list(repeat->getBody(), changed);
+        Expr* condition = rewrite(repeat->getCondition(), replace);
+        if (!changed && condition == repeat->getCondition()) {
+            return stmt;
+        }
+        return arena.make<RepeatStatement>(body, condition);
+    }
+    if (auto write = dynamic_cast<WriteStatement*>(stmt)) {
+        bool changed = false;
+        std::vector<Expr*> operands;
+        for (Expr* operand : write->getOperands()) {
+            operands.push_back(rewrite(operand, replace));
+            changed |= operands.back() != operand;
+        }
+        return changed ? arena.make<WriteStatement>(ArenaList<Expr*>(arena, operands)) : stmt;
+    }
+    return stmt;
+}
+
+template <typename Replace>
+Expr* Optimizer::rewrite(Expr* e, Replace& replace)
+{
+    if (Expr* replaced = replace(e)) {
+        return replaced;
+    }
+    if (auto binary = dynamic_cast<BinaryExpr*>(e)) {
+        Expr* left = rewrite(binary->getLeft(), replace);
+        Expr* right = rewrite(binary->getRight(), replace);
+        if (left == binary->getLeft() && right == binary->getRight()) {
+            return e;
+        }
+        return makeBinaryExpr(arena, left, binary->getOperator(), right);
+    }
+    if (auto grouping = dynamic_cast<GroupingExpression*>(e)) {
+        Expr* inner = rewrite(grouping->getExpression(), replace);
+        return inner == grouping->getExpression() ? e : arena.make<GroupingExpression>(inner);
+    }
+    return e;
+}
+
+// `stmts` with its loops optimized. `assigned` holds the variables certainly
+// defined before the list and `known` those with a known integer value;
+// both are updated to hold after it.
+std::vector<Statement*> Optimizer::loops(const std::vector<Statement*>& stmts, Names& assigned, Constants& known)
+{
+    std::vector<Statement*> result;
+    for (Statement* stmt : stmts) {
+        if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+            std::string_view name = assignment->getIdentifier().lexeme;
+            assigned.insert(name);
+            if (auto constant = integerConstant(assignment->getExpression())) {
+                known[name] = constant->getValue();
+            } else {
+                known.erase(name);
+            }
+            result.push_back(stmt);
+        } else if (auto read = dynamic_cast<ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                assigned.insert(identifier.lexeme);
+                known.erase(identifier.lexeme);
+            }
+            result.push_back(stmt);
+        } else if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+            const ArenaList<Statement*>& thenList = ifStmt->getThenBranch();
+            const ArenaList<Statement*>& elseList = ifStmt->getElseBranch();
+            Names thenAssigned = assigned, elseAssigned = assigned;
+            Constants thenKnown = known, elseKnown = known;
+            std::vector<Statement*> thenBranch = loops(std::vector<Statement*>(thenList.begin(), thenList.end()), thenAssigned, thenKnown);
+            std::vector<Statement*> elseBranch = loops(std::vector<Statement*>(elseList.begin(), elseList.end()), elseAssigned, elseKnown);
+            for (std::string_view name : thenAssigned) {
+                if (elseAssigned.count(name)) {
+                    assigned.insert(name);
+                }
+            }
+            forget(stmt, known);
+            bool changed = !std::equal(thenBranch.begin(), thenBranch.end(), thenList.begin(), thenList.end())
+                || !std::equal(elseBranch.begin(), elseBranch.end(), elseList.begin(), elseList.end());
+            result.push_back(changed
+                    ? arena.make<IfStatement>(ifStmt->getCondition(), ArenaList<Statement*>(arena, thenBranch), ArenaList<Statement*>(arena, elseBranch))
+                    : stmt);
+        } else if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+            Names entry = assigned;
+            Constants entryKnown = known;
+            // Later iterations see what the loop assigned.
+            forget(stmt, known);
+            const ArenaList<Statement*>& bodyList = repeat->getBody();
+            Constants bodyKnown = known;
+            std::vector<Statement*> body = loops(std::vector<Statement*>(bodyList.begin(), bodyList.end()), assigned, bodyKnown);
+            if (!std::equal(body.begin(), body.end(), bodyList.begin(), bodyList.end())) {
+                repeat = arena.make<RepeatStatement>(ArenaList<Statement*>(arena, body), repeat->getCondition());
+            }
+            optimizeLoop(repeat, entry, entryKnown, result);
+        } else {
+            result.push_back(stmt);
+        }
+    }
+    return result;
+}
+
+// Drops from `known` the variables `stmt` may assign.
+void Optimizer::forget(const Statement* stmt, Constants& known)
+{
+    Definitions definitions;
+    collectDefinitions(stmt, definitions);
+    for (const auto& definition : definitions) {
+        known.erase(definition.first);
+    }
+}
+
+// Appends `loop` to `out`, after the statements that set up the temporaries
+// it is rewritten to use. `entry` and `known` are the variables certainly
+// defined and those with a known value when it starts.
+void Optimizer::optimizeLoop(RepeatStatement* loop, const Names& entry, const Constants& known, std::vector<Statement*>& out)
+{
+    std::vector<Statement*> body(loop->getBody().begin(), loop->getBody().end());
+    Expr* condition = loop->getCondition();
+    Definitions definitions;
+    for (const Statement* stmt : body) {
+        collectDefinitions(stmt, definitions);
+    }
+
+    bool changed = reduceStrength(body, condition, known, definitions, out);
+    changed |= hoistInvariants(body, condition, definitions, entry, out);
+    out.push_back(changed ? arena.make<RepeatStatement>(ArenaList<Statement*>(arena, body), condition) : loop);
+}
+
+// Replaces `i * c` with a temporary kept equal to it by additions, when the
+// loop counts i by a constant step from a value in `known` to the constant
+// in its exit test.
+bool Optimizer::reduceStrength(std::vector<Statement*>& body, Expr*& condition, const Constants& known, Definitions& definitions, std::vector<Statement*>& out)
+{
+    // The counter is assigned once in the loop, by a step at the top of the
+    // body: i := i + d, i := d + i or i := i - d.
+    std::string_view counter;
+    size_t stepAt = 0;
+    float step = 0;
+    for (; stepAt < body.size(); stepAt++) {
+        auto assignment = dynamic_cast<AssignmentStatement*>(body[stepAt]);
+        if (!assignment) {
+            continue;
+        }
+        counter = assignment->getIdentifier().lexeme;
+        auto start = known.find(counter);
+        if (definitions[counter] != 1 || start == known.end() || !isExactInteger(start->second)) {
+            continue;
+        }
+        auto binary = dynamic_cast<BinaryExpr*>(assignment->getExpression());
+        if (!binary) {
+            continue;
+        }
+        Token::Type op = binary->getOperator().type;
+        const ConstantExpr* delta = nullptr;
+        if (isVariable(binary->getLeft(), counter)) {
+            delta = integerConstant(binary->getRight());
+        } else if (op == Token::Type::PLUS && isVariable(binary->getRight(), counter)) {
+            delta = integerConstant(binary->getLeft());
+        }
+        if (!delta || (op != Token::Type::PLUS && op != Token::Type::MINUS)) {
+            continue;
+        }
+        step = op == Token::Type::PLUS ? delta->getValue() : -delta->getValue();
+        if (step != 0) {
+            break;
+        }
+    }
+    if (stepAt == body.size()) {
+        return false;
+    }
+    float start = known.at(counter);
+
+    // The exit test must stop the counter: i >= n or i > n counting up,
+    // i <= n or i < n counting down, either way round.
+    auto test = dynamic_cast<BinaryExpr*>(condition);
+    if (!test) {
+        return false;
+    }
+    Token::Type op = test->getOperator().type;
+    const ConstantExpr* limit = nullptr;
+    if (isVariable(test->getLeft(), counter)) {
+        limit = integerConstant(test->getRight());
+    } else if (isVariable(test->getRight(), counter)) {
+        limit = integerConstant(test->getLeft());
+        switch (op) {
+        case Token::Type::LESS_THAN: op = Token::Type::GREATER_THAN; break;
+        case Token::Type::LESS_EQUAL: op = Token::Type::GREATER_EQUAL; break;
+        case Token::Type::GREATER_THAN: op = Token::Type::LESS_THAN; break;
+        case Token::Type::GREATER_EQUAL: op = Token::Type::LESS_EQUAL; break;
+        default: break;
+        }
+    }
+    bool stops = step > 0 ? op == Token::Type::GREATER_EQUAL || op == Token::Type::GREATER_THAN
+                          : op == Token::Type::LESS_EQUAL || op == Token::Type::LESS_THAN;
+    if (!limit || !stops) {
+        return false;
+    }
+    // The counter runs from the start towards the limit and stops at most
+    // one step past it.
+    float largest = std::max(std::fabs(start), std::fabs(limit->getValue())) + std::fabs(step);
+    if (largest > EXACT_LIMIT) {
+        return false;
+    }
+
+    std::map<float, Expr*> products;
+    std::vector<Statement*> updates;
+    auto replace = [&](Expr* e) -> Expr* {
+        auto binary = dynamic_cast<BinaryExpr*>(e);
+        if (!binary || binary->getOperator().type != Token::Type::MULTIPLY) {
+            return nullptr;
+        }
+        const ConstantExpr* factor = nullptr;
+        if (isVariable(binary->getLeft(), counter)) {
+            factor = integerConstant(binary->getRight());
+        } else if (isVariable(binary->getRight(), counter)) {
+            factor = integerConstant(binary->getLeft());
+        }
+        if (!factor || largest * std::fabs(factor->getValue()) > EXACT_LIMIT) {
+            return nullptr;
+        }
+        float c = factor->getValue();
+        auto found = products.find(c);
+        if (found != products.end()) {
+            return found->second;
+        }
+        Token name = temporary();
+        Token plus(Token::Type::PLUS, Token::getSpelling(Token::Type::PLUS), 0, 0, 0, 0);
+        Expr* product = arena.make<VariableExpr>(name);
+        // On the int64 path the temporary has the type `i * c` had.
+        auto constant = [&](float value) -> Expr* {
+            if (integers && types.isInteger(counter) && factor->isInteger()) {
+                return arena.make<ConstantExpr>(value, static_cast<int64_t>(value));
+            }
+            return arena.make<ConstantExpr>(value);
+        };
+        out.push_back(arena.make<AssignmentStatement>(name, constant(start * c)));
+        updates.push_back(arena.make<AssignmentStatement>(name, makeBinaryExpr(arena, product, plus, constant(step * c))));
+        definitions[name.lexeme]++;
+        products.emplace(c, product);
+        counts.reducedMultiplications++;
+        return product;
+    };
+    for (Statement*& stmt : body) {
+        stmt = rewrite(stmt, replace);
+    }
+    condition = rewrite(condition, replace);
+    body.insert(body.begin() + stepAt + 1, updates.begin(), updates.end());
+    return !updates.empty();
+}
+
+// Replaces the largest invariant subtrees in the loop with temporaries
+// assigned before it.
+bool Optimizer::hoistInvariants(std::vector<Statement*>& body, Expr*& condition, const Definitions& definitions, const Names& entry, std::vector<Statement*>& out)
+{
+    std::map<std::string, Expr*> hoisted;
+    auto replace = [&](Expr* e) -> Expr* {
+        bool hasVariable = false;
+        if (!dynamic_cast<BinaryExpr*>(e) || !isInvariant(e, definitions, entry, integers ? &types : nullptr, hasVariable) || !hasVariable) {
+            return nullptr;
+        }
+        std::string key = invariantKey(e);
+        auto found = hoisted.find(key);
+        if (found != hoisted.end()) {
+            return found->second;
+        }
+        Token name = temporary();
+        out.push_back(arena.make<AssignmentStatement>(name, e));
+        Expr* value = arena.make<VariableExpr>(name);
+        hoisted.emplace(key, value);
+        counts.hoistedExpressions++;
+        return value;
+    };
+    for (Statement*& stmt : body) {
+        stmt = rewrite(stmt, replace);
+    }
+    condition = rewrite(condition, replace);
+    return !hoisted.empty();
+}
+
+// Removes dead stores. For the int64 path, a variable TypeInference runs on
+// float keeps its stores if removing them would make it an integer there
+// while something still reads it: its value, and what the program prints,
+// would change. Since that can make other variables integers too, this
+// repeats until no more variables need keeping.
+std::vector<Statement*> Optimizer::eliminateDeadStores(const std::vector<Statement*>& program)
+{
+    if (!integers) {
+        Names assigned, live;
+        std::set<const Statement*> removable;
+        findRemovableStores(program, assigned, nullptr, removable);
+        return removeDeadStores(program, live, removable, true);
+    }
+    SymbolRegistry noSymbols;
+    TypeInference original = TypeInference::infer(program, noSymbols);
+    Names kept;
+    OptimizationStats before = counts;
+    while (true) {
+        Names assigned, live;
+        std::set<const Statement*> removable;
+        findRemovableStores(program, assigned, &original, removable);
+        for (auto it = removable.begin(); it != removable.end();) {
+            auto assignment = dynamic_cast<const AssignmentStatement*>(*it);
+            it = kept.count(assignment->getIdentifier().lexeme) ? removable.erase(it) : std::next(it);
+        }
+        std::vector<Statement*> result = removeDeadStores(program, live, removable, true);
+
+        Names uses;
+        for (const Statement* stmt : result) {
+            collectUses(stmt, uses);
+        }
+        TypeInference after = TypeInference::infer(result, noSymbols);
+        size_t keeping = kept.size();
+        for (std::string_view name : uses) {
+            if (!original.isInteger(name) && after.isInteger(name)) {
+                kept.insert(name);
+            }
+        }
+        if (kept.size() == keeping) {
+            return result;
+        }
+        counts = before;
+    }
+}
+
+// Adds to `removable` the assignments in `stmts` that cannot throw, so that
+// dropping them when dead changes nothing. `assigned` holds the variables
+// certainly defined before the list and is updated to those after it. A
+// loop body is checked as on its first iteration; later ones only define
+// more. `types` is set for the int64 path.
+void Optimizer::findRemovableStores(const std::vector<Statement*>& stmts, Names& assigned, const TypeInference* types, std::set<const Statement*>& removable)
+{
+    for (const Statement* stmt : stmts) {
+        if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            if (cannotThrow(assignment->getExpression(), assigned, types)) {
+                removable.insert(stmt);
+            }
+            assigned.insert(assignment->getIdentifier().lexeme);
+        } else if (auto read = dynamic_cast<const ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                assigned.insert(identifier.lexeme);
+            }
+        } else if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+            const ArenaList<Statement*>& thenList = ifStmt->getThenBranch();
+            const ArenaList<Statement*>& elseList = ifStmt->getElseBranch();
+            Names thenAssigned = assigned, elseAssigned = assigned;
+            findRemovableStores(std::vector<Statement*>(thenList.begin(), thenList.end()), thenAssigned, types, removable);
+            findRemovableStores(std::vector<Statement*>(elseList.begin(), elseList.end()), elseAssigned, types, removable);
+            for (std::string_view name : thenAssigned) {
+                if (elseAssigned.count(name)) {
+                    assigned.insert(name);
+                }
+            }
+        } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+            const ArenaList<Statement*>& body = repeat->getBody();
+            findRemovableStores(std::vector<Statement*>(body.begin(), body.end()), assigned, types, removable);
+        }
+    }
+}
+
+// `stmts` without the removable assignments whose value is not read before
+// it is overwritten or the program ends. `live` holds the variables that
+// may be read after the list and is updated to those that may be read from
+// its start. Only counts and builds the new list if `rebuild` is set.
+std::vector<Statement*> Optimizer::removeDeadStores(const std::vector<Statement*>& stmts, Names& live, const std::set<const Statement*>& removable, bool rebuild)
+{
+    std::vector<Statement*> result;
+    for (auto it = stmts.rbegin(); it != stmts.rend(); ++it) {
+        Statement* stmt = *it;
+        if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+            std::string_view name = assignment->getIdentifier().lexeme;
+            if (!live.count(name) && removable.count(stmt)) {
+                if (rebuild) {
+                    counts.removedStores++;
+                    counts.removedNodes += countNodes(assignment->getExpression());
+                }
+                continue;
+            }
+            live.erase(name);
+            collectUses(assignment->getExpression(), live);
+        } else if (auto read = dynamic_cast<ReadStatement*>(stmt)) {
+            for (const Token& identifier : read->getIdentifiers()) {
+                live.erase(identifier.lexeme);
+            }
+        } else if (auto write = dynamic_cast<WriteStatement*>(stmt)) {
+            for (const Expr* operand : write->getOperands()) {
+                collectUses(operand, live);
+            }
+        } else if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+            const ArenaList<Statement*>& thenList = ifStmt->getThenBranch();
+            const ArenaList<Statement*>& elseList = ifStmt->getElseBranch();
+            Names elseLive = live;
+            std::vector<Statement*> thenBranch = removeDeadStores(std::vector<Statement*>(thenList.begin(), thenList.end()), live, removable, rebuild);
+            std::vector<Statement*> elseBranch = removeDeadStores(std::vector<Statement*>(elseList.begin(), elseList.end()), elseLive, removable, rebuild);
+            live.insert(elseLive.begin(), elseLive.end());
+            collectUses(ifStmt->getCondition(), live);
+            if (rebuild && (!std::equal(thenBranch.begin(), thenBranch.end(), thenList.begin(), thenList.end())
+                               || !std::equal(elseBranch.begin(), elseBranch.end(), elseList.begin(), elseList.end()))) {
+                stmt = arena.make<IfStatement>(ifStmt->getCondition(), ArenaList<Statement*>(arena, thenBranch), ArenaList<Statement*>(arena, elseBranch));
+            }
+        } else if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+            // At the end of the body, the condition is read, and then either
+            // what follows the loop or the body again.
+            const ArenaList<Statement*>& bodyList = repeat->getBody();
+            std::vector<Statement*> body(bodyList.begin(), bodyList.end());
+            Names after = live;
+            collectUses(repeat->getCondition(), after);
+            Names end = after;
+            for (;;) {
+                Names start = end;
+                removeDeadStores(body, start, removable, false);
+                size_t size = end.size();
+                end.insert(start.begin(), start.end());
+                if (end.size() == size) {
+                    break;
+                }
+            }
+            live = end;
+            body = removeDeadStores(body, live, removable, rebuild);
+            if (rebuild && !std::equal(body.begin(), body.end(), bodyList.begin(), bodyList.end())) {
+                stmt = arena.make<RepeatStatement>(ArenaList<Statement*>(arena, body), repeat->getCondition());
+            }
+        }
+        if (rebuild) {
+            result.push_back(stmt);
+        }
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+// `stmt` as a fused statement if it is one of the idioms they cover, with
+// the statements in it fused too.
+Statement* Optimizer::fuse(Statement* stmt)
+{
+    if (auto assignment = dynamic_cast<AssignmentStatement*>(stmt)) {
+        auto binary = dynamic_cast<BinaryExpr*>(assignment->getExpression());
+        if (!binary) {
+            return stmt;
+        }
+        std::string_view name = assignment->getIdentifier().lexeme;
+        Token::Type op = binary->getOperator().type;
+        auto left = dynamic_cast<VariableExpr*>(binary->getLeft());
+        auto right = dynamic_cast<VariableExpr*>(binary->getRight());
+        float value;
+        if (op == Token::Type::PLUS || op == Token::Type::MINUS) {
+            if (isVariable(left, name) && BinaryOps::constantValue(binary->getRight(), value)) {
+                counts.fusedIncrements++;
+                return arena.make<IncrementStatement>(assignment->getIdentifier(), binary, left, op == Token::Type::PLUS ? value : -value);
+            }
+            if (op == Token::Type::PLUS && isVariable(right, name) && BinaryOps::constantValue(binary->getLeft(), value)) {
+                counts.fusedIncrements++;
+                return arena.make<IncrementStatement>(assignment->getIdentifier(), binary, right, value);
+            }
+        }
+        if (!isVariable(left, name)) {
+            return stmt;
+        }
+        switch (op) {
+        case Token::Type::PLUS:
+            counts.fusedAccumulations++;
+            return arena.make<AccumulateStatement<BinaryOps::Plus>>(assignment->getIdentifier(), binary);
+        case Token::Type::MINUS:
+            counts.fusedAccumulations++;
+            return arena.make<AccumulateStatement<BinaryOps::Minus>>(assignment->getIdentifier(), binary);
+        case Token::Type::MULTIPLY:
+            counts.fusedAccumulations++;
+            return arena.make<AccumulateStatement<BinaryOps::Multiply>>(assignment->getIdentifier(), binary);
+        default:
+            return stmt;
+        }
+    }
+    if (auto ifStmt = dynamic_cast<IfStatement*>(stmt)) {
+        ArenaList<Statement*> thenBranch = fuse(ifStmt->getThenBranch());
+        ArenaList<Statement*> elseBranch = fuse(ifStmt->getElseBranch());
+        if (thenBranch.begin() == ifStmt->getThenBranch().begin() && elseBranch.begin() == ifStmt->getElseBranch().begin()) {
+            return stmt;
+        }
+        return arena.make<IfStatement>(ifStmt->getCondition(), thenBranch, elseBranch);
+    }
+    if (auto repeat = dynamic_cast<RepeatStatement*>(stmt)) {
+        ArenaList<Statement*> body = fuse(repeat->getBody());
+        auto test = dynamic_cast<BinaryExpr*>(repeat->getCondition());
+        float limit;
+        if (test && dynamic_cast<VariableExpr*>(test->getLeft()) && BinaryOps::constantValue(test->getRight(), limit)) {
+            switch (test->getOperator().type) {
+            case Token::Type::LESS_THAN:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::Less>>(body, test, limit);
+            case Token::Type::LESS_EQUAL:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::LessEqual>>(body, test, limit);
+            case Token::Type::GREATER_THAN:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::Greater>>(body, test, limit);
+            case Token::Type::GREATER_EQUAL:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::GreaterEqual>>(body, test, limit);
+            case Token::Type::EQUAL:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::Equal>>(body, test, limit);
+            case Token::Type::NOT_EQUAL:
+                counts.fusedLoopExits++;
+                return arena.make<RepeatUntilCompareStatement<BinaryOps::NotEqual>>(body, test, limit);
+            default:
+                break;
+            }
+        }
+        if (body.begin() == repeat->getBody().begin()) {
+            return stmt;
+        }
+        return arena.make<RepeatStatement>(body, repeat->getCondition());
+    }
+    return stmt;
+}
+
+ArenaList<Statement*> Optimizer::fuse(const ArenaList<Statement*>& stmts)
+{
+    std::vector<Statement*> result;
+    bool changed = false;
+    for (Statement* stmt : stmts) {
+        result.push_back(fuse(stmt));
+        changed |= result.back() != stmt;
+    }
+    return changed ? ArenaList<Statement*>(arena, result) : stmts;
+}
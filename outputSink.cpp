@@ -0,0 +1,83 @@
+#include "outputSink.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+OutputSink::OutputSink(int fd, size_t capacity, std::chrono::milliseconds interval)
+    : fd(fd)
+    , buffer(capacity > 0 ? capacity : 1)
+    , interval(interval)
+    , deadline(std::chrono::steady_clock::now())
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+OutputSink::~OutputSink()
+{
+    drain();
+}
+
+OutputSink::int_type OutputSink::overflow(int_type c)
+{
+    if (!drain()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize OutputSink::xsputn(const char* s, std::streamsize n)
+{
+    if (n <= epptr() - pptr()) {
+        std::memcpy(pptr(), s, n);
+        pbump(static_cast<int>(n));
+        return n;
+    }
+    if (!drain()) {
+        return 0;
+    }
+    // Anything the empty buffer cannot hold goes out as it is.
+    if (static_cast<size_t>(n) >= buffer.size()) {
+        return writeAll(s, n) ? n : 0;
+    }
+    std::memcpy(pptr(), s, n);
+    pbump(static_cast<int>(n));
+    return n;
+}
+
+int OutputSink::sync()
+{
+    return drain() ? 0 : -1;
+}
+
+bool OutputSink::drain()
+{
+    size_t pending = pptr() - pbase();
+    setp(buffer.data(), buffer.data() + buffer.size());
+    deadline = std::chrono::steady_clock::now() + interval;
+    return pending == 0 || writeAll(buffer.data(), pending);
+}
+
+bool OutputSink::writeAll(const char* data, size_t size)
+{
+    if (failed) {
+        return false;
+    }
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        ++writes;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
@@ -1,12 +1,18 @@
 #include "parser.h"
+#include <array>
+#include <cstdint>
+#include <algorithm>
 #include <numeric>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 Parser::Parser(Lexer& lexer)
     : lexer(lexer)
     , currentToken(lexer.nextToken())
     , previousToken(currentToken)
+    , arena(make_unique<Arena>())
 {
 }
 
@@ -17,15 +23,257 @@ vector<Statement*> Parser::parse()
     return statements;
 }
 
+ParseResult Parser::parseProgram()
+{
+    ParseResult result;
+    result.statements = parse();
+    result.errors = errors;
+    result.arena = std::move(arena);
+    arena = make_unique<Arena>();
+    return result;
+}
+
+ParseResult Parser::parseText(string source)
+{
+    auto text = make_unique<string>(std::move(source));
+    Lexer lexer(*text);
+    Parser parser(lexer);
+    vector<StatementSpan> spans;
+    parser.spanSource = text->data();
+    parser.spans = &spans;
+
+    ParseResult result = parser.parseProgram();
+    result.source = std::move(text);
+    result.spans = std::move(spans);
+    return result;
+}
+
+TextEdit TextEdit::between(string_view before, string_view after)
+{
+    size_t limit = min(before.size(), after.size());
+    size_t prefix = mismatch(before.begin(), before.begin() + limit, after.begin()).first - before.begin();
+    size_t suffix = mismatch(before.rbegin(), before.rbegin() + (limit - prefix), after.rbegin()).first - before.rbegin();
+    return TextEdit { prefix, before.size() - prefix - suffix, string(after.substr(prefix, after.size() - prefix - suffix)) };
+}
+
+// Offset in `source` of the first byte of `token`, which must have been
+// lexed from it. Literal lexemes leave out the opening quote.
+static size_t sourceOffset(const Token& token, const char* source)
+{
+    return token.lexeme.data() - source - (token.type == Token::Type::LITERAL ? 1 : 0);
+}
+
+ParseResult Parser::reparse(ParseResult previous, const TextEdit& edit)
+{
+    if (!previous.source || edit.offset > previous.source->size() || edit.removedLength > previous.source->size() - edit.offset) {
+        throw out_of_range("Edit lies outside the parsed text");
+    }
+
+    const string& oldText = *previous.source;
+    size_t editEnd = edit.offset + edit.removedLength;
+    string newText;
+    newText.reserve(oldText.size() - edit.removedLength + edit.insertedText.size());
+    newText.append(oldText, 0, edit.offset).append(edit.insertedText).append(oldText, editEnd, string::npos);
+
+    const vector<StatementSpan>& oldSpans = previous.spans;
+    if (previous.isError() || oldSpans.empty() || previous.retained.size() >= MAX_RETAINED_PARSES) {
+        return parseText(std::move(newText));
+    }
+
+    // Statements that end before the edit are kept, bar the last of them:
+    // the token after an if's `end` decides whether an `else` joins it. A
+    // statement ending right at the edit could have its last token grow
+    // into the inserted text, so it is not counted as before the edit.
+    size_t first = 0;
+    while (first < oldSpans.size() && oldSpans[first].end < edit.offset) {
+        first++;
+    }
+    SourceMap::Position restart { 1, 1 };
+    size_t restartOffset = 0;
+    if (first > 0) {
+        first--;
+        restart = SourceMap::Position { oldSpans[first].line, oldSpans[first].column };
+        restartOffset = oldSpans[first].begin;
+    }
+
+    auto text = make_unique<string>(std::move(newText));
+    Lexer lexer(*text, restartOffset, restart);
+    Parser parser(lexer);
+    vector<StatementSpan> spans(oldSpans.begin(), oldSpans.begin() + first);
+    parser.spanSource = text->data();
+    parser.spans = &spans;
+
+    // Re-parse until the next token starts an old statement lying wholly
+    // after the edit. From there to the end the text is unchanged, and so
+    // are its tokens and statements.
+    vector<Statement*> statements(previous.statements.begin(), previous.statements.begin() + first);
+    size_t resume = first;
+    while (resume < oldSpans.size() && oldSpans[resume].begin < editEnd) {
+        resume++;
+    }
+    while (true) {
+        if (parser.currentToken.type == Token::Type::ENDOFFILE) {
+            resume = oldSpans.size();
+            break;
+        }
+        size_t offset = sourceOffset(parser.currentToken, text->data());
+        while (resume < oldSpans.size() && oldSpans[resume].begin + edit.insertedText.size() - edit.removedLength < offset) {
+            resume++;
+        }
+        if (resume < oldSpans.size() && oldSpans[resume].begin + edit.insertedText.size() - edit.removedLength == offset) {
+            break;
+        }
+        statements.push_back(parser.spannedStatement());
+        if (parser.isError()) {
+            return parseText(std::move(*text));
+        }
+    }
+
+    // Statements after the edit keep their text but may sit on other lines
+    // now. Without a line change, only those on the line the edit ended on
+    // have moved (sideways).
+    if (resume < oldSpans.size()) {
+        const StatementSpan& old = oldSpans[resume];
+        const Token& next = parser.currentToken;
+        PositionShift shift { old.line, next.start_line - old.line, next.start_column - old.column };
+        for (size_t i = resume; i < oldSpans.size(); i++) {
+            StatementSpan span = oldSpans[i];
+            if (shift.lineDelta != 0 || span.line == shift.line) {
+                previous.statements[i]->shiftPositions(shift);
+                if (span.line == shift.line) {
+                    span.column += shift.columnDelta;
+                }
+                span.line += shift.lineDelta;
+            }
+            span.begin = span.begin + edit.insertedText.size() - edit.removedLength;
+            span.end = span.end + edit.insertedText.size() - edit.removedLength;
+            spans.push_back(span);
+            statements.push_back(previous.statements[i]);
+        }
+    }
+
+    ParseResult result;
+    result.arena = std::move(parser.arena);
+    result.statements = std::move(statements);
+    result.source = std::move(text);
+    result.spans = std::move(spans);
+    if (first > 0 || resume < oldSpans.size()) {
+        result.retained = std::move(previous.retained);
+        result.retained.push_back(ParseResult::Retained { std::move(previous.arena), std::move(previous.source) });
+    }
+    return result;
+}
+
+// Picks up to `count` - 1 token indices, spread evenly over `tokens`, at
+// which a top-level statement starts. Only keyword nesting is looked at:
+// if/repeat open a level, end/until close one, and an else straight after
+// an end reopens it. Returns nothing when the nesting does not balance;
+// such a program has syntax errors anyway.
+static vector<size_t> findStatementSplits(const TokenBuffer& tokens, size_t count)
+{
+    vector<size_t> splits;
+    size_t last = tokens.size() - 1; // the ENDOFFILE
+    int depth = 0;
+    for (size_t i = 0; i < last; i++) {
+        bool ended = false;
+        switch (tokens.type(i)) {
+        case Token::Type::IF:
+        case Token::Type::REPEAT:
+        case Token::Type::ELSE:
+            depth++;
+            break;
+        case Token::Type::UNTIL:
+            depth--;
+            break;
+        case Token::Type::END:
+            depth--;
+            ended = depth == 0 && tokens.type(i + 1) != Token::Type::ELSE;
+            break;
+        case Token::Type::SEMI_COLON:
+            ended = depth == 0;
+            break;
+        default:
+            break;
+        }
+        if (depth < 0) {
+            return {};
+        }
+        if (ended && splits.size() + 1 < count && i + 1 >= last * (splits.size() + 1) / count) {
+            splits.push_back(i + 1);
+        }
+    }
+    if (depth != 0) {
+        return {};
+    }
+    return splits;
+}
+
+ParseResult Parser::parseParallel(string_view source, unsigned threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+    TokenBuffer tokens = Lexer::tokenizeParallel(source, threadCount);
+
+    // Below this a chunk isn't worth a thread.
+    const size_t minChunkTokens = 64 * 1024;
+    size_t chunks = min<size_t>(threadCount, tokens.size() / minChunkTokens);
+    vector<size_t> bounds = chunks > 1 ? findStatementSplits(tokens, chunks) : vector<size_t>();
+    if (!bounds.empty()) {
+        bounds.insert(bounds.begin(), 0);
+        bounds.push_back(tokens.size());
+        chunks = bounds.size() - 1;
+
+        vector<ParseResult> parts(chunks);
+        vector<thread> workers;
+        for (size_t i = 0; i < chunks; i++) {
+            workers.emplace_back([&, i] {
+                Lexer lexer(tokens, bounds[i], bounds[i + 1]);
+                Parser parser(lexer);
+                parts[i] = parser.parseProgram();
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        // Chunks stand alone only if each parsed cleanly; otherwise error
+        // recovery could have run differently across a split.
+        bool clean = all_of(parts.begin(), parts.end(), [](const ParseResult& part) { return !part.isError(); });
+        if (clean) {
+            ParseResult result = std::move(parts[0]);
+            for (size_t i = 1; i < chunks; i++) {
+                result.arena->adopt(*parts[i].arena);
+                result.statements.insert(result.statements.end(), parts[i].statements.begin(), parts[i].statements.end());
+            }
+            return result;
+        }
+    }
+
+    Lexer lexer(tokens, 0, tokens.size());
+    Parser parser(lexer);
+    return parser.parseProgram();
+}
+
 vector<Statement*> Parser::program()
 {
     vector<Statement*> statements;
     while (currentToken.type != Token::Type::ENDOFFILE) {
-        statements.push_back(statement());
+        statements.push_back(spans ? spannedStatement() : statement());
     }
     return statements;
 }
 
+// statement(), also recording where in `spanSource` the statement lies.
+Statement* Parser::spannedStatement()
+{
+    StatementSpan span { sourceOffset(currentToken, spanSource), 0, currentToken.start_line, currentToken.start_column };
+    Statement* stmt = statement();
+    span.end = sourceOffset(previousToken, spanSource) + previousToken.lexeme.size();
+    spans->push_back(span);
+    return stmt;
+}
+
 Statement* Parser::statement()
 {
     try {
@@ -56,7 +304,7 @@ Statement* Parser::assignment()
     consume(Token::Type::ASSIGNMENT, "Expect ':=' after identifier.");
     Expr* expr = expression();
     consume(Token::Type::SEMI_COLON, "Expect ';' after statement.");
-    return new AssignmentStatement(identifier, expr);
+    return arena->make<AssignmentStatement>(identifier, expr);
 }
 
 Statement* Parser::ifStatement()
@@ -80,7 +328,7 @@ Statement* Parser::ifStatement()
         consume(Token::Type::END, "Expect 'end' keyword.");
     }
 
-    return new IfStatement(condition, thenBranch, elseBranch);
+    return arena->make<IfStatement>(condition, ArenaList<Statement*>(*arena, thenBranch), ArenaList<Statement*>(*arena, elseBranch));
 }
 
 Statement* Parser::repeatStatement()
@@ -95,7 +343,7 @@ Statement* Parser::repeatStatement()
 
     Expr* condition = expression();
     consume(Token::Type::SEMI_COLON, "Expect ';' after statement.");
-    return new RepeatStatement(body, condition);
+    return arena->make<RepeatStatement>(ArenaList<Statement*>(*arena, body), condition);
 }
 
 /*
@@ -117,7 +365,7 @@ Statement* Parser::writeStatement()
     } while (match(Token::Type::COMMA));
 
     consume(Token::Type::SEMI_COLON, "Expect ';' after statement.");
-    return new WriteStatement(expressions);
+    return arena->make<WriteStatement>(ArenaList<Expr*>(*arena, expressions));
 }
 
 Statement* Parser::readStatement()
@@ -132,86 +380,74 @@ Statement* Parser::readStatement()
     } while (match(Token::Type::COMMA));
 
     consume(Token::Type::SEMI_COLON, "Expect ';' after statement.");
-    return new ReadStatement(identifiers);
+    return arena->make<ReadStatement>(ArenaList<Token>(*arena, identifiers));
 }
 
-Token Parser::previous()
+const Token& Parser::previous()
 {
     return previousToken;
 }
 
-Expr* Parser::expression()
-{
-    return this->equality();
-}
-
-Expr* Parser::equality()
-{
-    Expr* left = this->comparison();
-    while (match(Token::Type::EQUAL)) {
-        Token operatorToken = previous();
-        Expr* right = this->comparison();
-        left = new BinaryExpr(left, operatorToken, right);
-    }
-
-    return left;
-}
-
-// 1 + 2< 2 + 3
-
-Expr* Parser::comparison()
-{
-    Expr* left = this->term();
-    while (match(Token::Type::LESS_THAN) || match(Token::Type::GREATER_THAN) || match(Token::Type::LESS_EQUAL) || match(Token::Type::GREATER_EQUAL)) {
-        Token operatorToken = previous();
-        Expr* right = this->term();
-        left = new BinaryExpr(left, operatorToken, right);
-    }
+// Binding power of each binary operator, indexed by token type; 0 means the
+// token does not continue an expression. Higher binds tighter, and every
+// level is left-associative.
+//
+//   =                 1
+//   <  >  <=  >=      2
+//   +  -              3
+//   *  /              4
+static constexpr array<uint8_t, static_cast<size_t>(Token::Type::ENDOFFILE) + 1> binaryPrecedence = [] {
+    array<uint8_t, static_cast<size_t>(Token::Type::ENDOFFILE) + 1> table {};
+    table[static_cast<size_t>(Token::Type::EQUAL)] = 1;
+    table[static_cast<size_t>(Token::Type::LESS_THAN)] = 2;
+    table[static_cast<size_t>(Token::Type::GREATER_THAN)] = 2;
+    table[static_cast<size_t>(Token::Type::LESS_EQUAL)] = 2;
+    table[static_cast<size_t>(Token::Type::GREATER_EQUAL)] = 2;
+    table[static_cast<size_t>(Token::Type::PLUS)] = 3;
+    table[static_cast<size_t>(Token::Type::MINUS)] = 3;
+    table[static_cast<size_t>(Token::Type::MULTIPLY)] = 4;
+    table[static_cast<size_t>(Token::Type::DIVIDE)] = 4;
+    return table;
+}();
 
-    return left;
-}
-
-// 1 + 2 * 3
-
-Expr* Parser::term()
+Expr* Parser::expression()
 {
-    Expr* left = this->factor();
-    while (match(Token::Type::PLUS) || match(Token::Type::MINUS)) {
-        Token operatorToken = previous();
-        Expr* right = this->factor();
-        left = new BinaryExpr(left, operatorToken, right);
-    }
-
-    return left;
+    return this->expression(1);
 }
 
-Expr* Parser::factor()
+// Precedence climbing: parses operands and every operator that binds at
+// least as tightly as `minPrecedence`. A lone operand costs one primary()
+// call and one table lookup.
+Expr* Parser::expression(int minPrecedence)
 {
     Expr* left = this->primary();
-    while (match(Token::Type::MULTIPLY) || match(Token::Type::DIVIDE)) {
-        Token operatorToken = previous();
-        Expr* right = this->primary();
-        left = new BinaryExpr(left, operatorToken, right);
+    while (true) {
+        int precedence = binaryPrecedence[static_cast<size_t>(currentToken.type)];
+        if (precedence == 0 || precedence < minPrecedence) {
+            return left;
+        }
+        Token operatorToken = currentToken;
+        advance();
+        Expr* right = this->expression(precedence + 1);
+        left = makeBinaryExpr(*arena, left, operatorToken, right);
     }
-
-    return left;
 }
 
 Expr* Parser::primary()
 {
     if (match(Token::Type::NUMBER)) {
-        return new NumberExpr(previous());
+        return arena->make<NumberExpr>(previous());
     }
     if (match(Token::Type::LITERAL)) {
-        return new LiteralExpr(previous());
+        return arena->make<LiteralExpr>(previous());
     }
     if (match(Token::Type::LEFT_PARENTHESIS)) {
         Expr* expr = this->expression();
         consume(Token::Type::RIGHT_PARENTHESIS, "Expect ')' after expression.");
-        return new GroupingExpression(expr);
+        return arena->make<GroupingExpression>(expr);
     }
     if (match(Token::Type::IDENTIFIER)) {
-        return new VariableExpr(previous());
+        return arena->make<VariableExpr>(previous());
     }
 
     // It's generally better to report an error at the current token
@@ -275,7 +511,7 @@ void Parser::consume(Token::Type type, const string& message)
     if (currentToken.type == Token::Type::ENDOFFILE) {
         errorMessage += " Found end of file instead.";
     } else {
-        errorMessage += " Found '" + currentToken.lexeme + "' instead.";
+        errorMessage += " Found '" + string(currentToken.lexeme) + "' instead.";
     }
     addError(currentToken, errorMessage); // Report error at the current token
     throw ParserError();
@@ -283,18 +283,23 @@ private slots:
         }
 
         try {
-            Lexer lexer(sourceStdString);
-            Parser parser(lexer);
-            auto statements = parser.parse();
-            if (parser.isError()) {
+            // Only the statements around what changed since the last parse
+            // are parsed again.
+            if (lastParse.source) {
+                TextEdit edit = TextEdit::between(*lastParse.source, sourceStdString);
+                lastParse = Parser::reparse(std::move(lastParse), edit);
+            } else {
+                lastParse = Parser::parseText(sourceStdString);
+            }
+            if (lastParse.isError()) {
                 outputArea->append("--- PARSER ERROR ---\n");
-                for (const auto& error : parser.getErrors()) {
+                for (const auto& error : lastParse.errors) {
                     outputArea->append(QString::fromStdString(error));
                 }
                 return;
             }
             string output;
-            for (const auto& stmt : statements) {
+            for (const auto& stmt : lastParse.statements) {
                 output += stmt->toString(0);
             }
             outputArea->append("--- PARSER OUTPUT ---\n");
@@ -361,6 +366,7 @@ private:
     QString curentFilePath;
     QTextEdit* outputArea;
     QLabel* statusBar;
+    ParseResult lastParse;
 };
 
 int main(int argc, char* argv[])
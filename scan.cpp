@@ -0,0 +1,228 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define SCAN_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if SCAN_HAVE_SSE2 && defined(__GNUC__)
+#define SCAN_HAVE_AVX2 1
+#include <immintrin.h>
+#define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace scan {
+
+namespace {
+
+    bool isSpace(unsigned char c)
+    {
+        // Same set as isspace() in the "C" locale.
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    const char* findByteScalar(const char* p, const char* end, char c)
+    {
+        while (p < end && *p != c) {
+            p++;
+        }
+        return p;
+    }
+
+    const char* skipWhitespaceScalar(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    size_t countByteScalar(const char* p, const char* end, char c)
+    {
+        size_t count = 0;
+        for (; p < end; p++) {
+            count += *p == c;
+        }
+        return count;
+    }
+
+#if SCAN_HAVE_SSE2
+    // Bytes in 0x09..0x0d or equal to 0x20 have their bit set in the mask.
+    inline int spaceMask16(__m128i v)
+    {
+        __m128i blank = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        // (v - 9) as unsigned <= 4  <=>  min(v - 9, 4) == v - 9
+        __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+        return _mm_movemask_epi8(_mm_or_si128(blank, control));
+    }
+
+    const char* findByteSSE2(const char* p, const char* end, char c)
+    {
+        __m128i needle = _mm_set1_epi8(c);
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+        return findByteScalar(p, end, c);
+    }
+
+    const char* skipWhitespaceSSE2(const char* p, const char* end)
+    {
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            int mask = ~spaceMask16(v) & 0xffff;
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+        return skipWhitespaceScalar(p, end);
+    }
+
+    size_t countByteSSE2(const char* p, const char* end, char c)
+    {
+        __m128i needle = _mm_set1_epi8(c);
+        size_t count = 0;
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+            p += 16;
+        }
+        return count + countByteScalar(p, end, c);
+    }
+#endif
+
+#if SCAN_HAVE_AVX2
+    SCAN_TARGET_AVX2 const char* findByteAVX2(const char* p, const char* end, char c)
+    {
+        __m256i needle = _mm256_set1_epi8(c);
+        while (end - p >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 32;
+        }
+        return findByteSSE2(p, end, c);
+    }
+
+    SCAN_TARGET_AVX2 const char* skipWhitespaceAVX2(const char* p, const char* end)
+    {
+        while (end - p >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i blank = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+            __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+            __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(blank, control)));
+            if (mask) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 32;
+        }
+        return skipWhitespaceSSE2(p, end);
+    }
+
+    SCAN_TARGET_AVX2 size_t countByteAVX2(const char* p, const char* end, char c)
+    {
+        __m256i needle = _mm256_set1_epi8(c);
+        size_t count = 0;
+        while (end - p >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            count += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle))));
+            p += 32;
+        }
+        return count + countByteSSE2(p, end, c);
+    }
+#endif
+
+    struct Dispatch {
+        Isa isa;
+        const char* (*findByte)(const char*, const char*, char);
+        const char* (*skipWhitespace)(const char*, const char*);
+        size_t (*countByte)(const char*, const char*, char);
+    };
+
+    Isa bestIsa()
+    {
+#if SCAN_HAVE_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            return Isa::AVX2;
+        }
+#endif
+#if SCAN_HAVE_SSE2
+        return Isa::SSE2;
+#else
+        return Isa::Scalar;
+#endif
+    }
+
+    Dispatch makeDispatch(Isa isa)
+    {
+        if (isa > bestIsa()) {
+            isa = bestIsa();
+        }
+        switch (isa) {
+#if SCAN_HAVE_AVX2
+        case Isa::AVX2:
+            return { Isa::AVX2, findByteAVX2, skipWhitespaceAVX2, countByteAVX2 };
+#endif
+#if SCAN_HAVE_SSE2
+        case Isa::SSE2:
+            return { Isa::SSE2, findByteSSE2, skipWhitespaceSSE2, countByteSSE2 };
+#endif
+        default:
+            return { Isa::Scalar, findByteScalar, skipWhitespaceScalar, countByteScalar };
+        }
+    }
+
+    Dispatch& dispatch()
+    {
+        static Dispatch table = makeDispatch(bestIsa());
+        return table;
+    }
+
+} // namespace
+
+Isa activeIsa()
+{
+    return dispatch().isa;
+}
+
+Isa useIsa(Isa isa)
+{
+    dispatch() = makeDispatch(isa);
+    return dispatch().isa;
+}
+
+const char* isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::SSE2: return "sse2";
+    case Isa::AVX2: return "avx2";
+    default: return "unknown";
+    }
+}
+
+const char* findByte(const char* p, const char* end, char c)
+{
+    return dispatch().findByte(p, end, c);
+}
+
+const char* skipWhitespace(const char* p, const char* end)
+{
+    return dispatch().skipWhitespace(p, end);
+}
+
+size_t countByte(const char* p, const char* end, char c)
+{
+    return dispatch().countByte(p, end, c);
+}
+
+} // namespace scan
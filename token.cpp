@@ -1,7 +1,7 @@
 #include "token.h"
 #include <sstream>
 
-Token::Token(Type type, const std::string &lexeme, int start_line, int start_column, int end_line, int end_column)
+Token::Token(Type type, std::string_view lexeme, int start_line, int start_column, int end_line, int end_column)
     : type(type), lexeme(lexeme), start_line(start_line), start_column(start_column), end_line(end_line), end_column(end_column) {}
 
 std::string Token::getTokenTypeName(Token::Type type)
@@ -41,6 +41,36 @@ std::string Token::getTokenTypeName(Token::Type type)
     }
 }
 
+std::string_view Token::getSpelling(Token::Type type)
+{
+    switch (type) {
+    case Type::IF: return "if";
+    case Type::THEN: return "then";
+    case Type::ELSE: return "else";
+    case Type::END: return "end";
+    case Type::REPEAT: return "repeat";
+    case Type::UNTIL: return "until";
+    case Type::WRITE: return "write";
+    case Type::READ: return "read";
+    case Type::EQUAL: return "=";
+    case Type::ASSIGNMENT: return ":=";
+    case Type::PLUS: return "+";
+    case Type::MINUS: return "-";
+    case Type::MULTIPLY: return "*";
+    case Type::DIVIDE: return "/";
+    case Type::LESS_THAN: return "<";
+    case Type::GREATER_THAN: return ">";
+    case Type::LESS_EQUAL: return "<=";
+    case Type::GREATER_EQUAL: return ">=";
+    case Type::NOT_EQUAL: return "!=";
+    case Type::LEFT_PARENTHESIS: return "(";
+    case Type::RIGHT_PARENTHESIS: return ")";
+    case Type::SEMI_COLON: return ";";
+    case Type::COMMA: return ",";
+    default: return "";
+    }
+}
+
 std::string Token::toString() const
 {
     std::ostringstream oss;
@@ -48,3 +78,15 @@ std::string Token::toString() const
         << start_line << ":" << start_column << " - " << end_line << ":" << end_column << ")";
     return oss.str();
 }
+
+void PositionShift::apply(Token& token) const
+{
+    if (token.start_line == line) {
+        token.start_column += columnDelta;
+    }
+    if (token.end_line == line) {
+        token.end_column += columnDelta;
+    }
+    token.start_line += lineDelta;
+    token.end_line += lineDelta;
+}
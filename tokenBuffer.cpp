@@ -0,0 +1,75 @@
+#include "tokenBuffer.h"
+#include "scan.h"
+#include <algorithm>
+#include <utility>
+
+SourceMap::SourceMap(std::string_view source)
+{
+    const char* begin = source.data();
+    const char* end = begin + source.size();
+    lineStarts.reserve(scan::countByte(begin, end, '\n') + 1);
+    lineStarts.push_back(0);
+    for (const char* p = scan::findByte(begin, end, '\n'); p != end; p = scan::findByte(p + 1, end, '\n')) {
+        lineStarts.push_back(p + 1 - begin);
+    }
+}
+
+SourceMap::Position SourceMap::position(size_t offset) const
+{
+    auto it = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    size_t line = it - lineStarts.begin();
+    return { static_cast<int>(line), static_cast<int>(offset - lineStarts[line - 1] + 1) };
+}
+
+TokenBuffer::TokenBuffer(std::string_view source)
+    : source(source)
+{
+}
+
+void TokenBuffer::push(Token::Type type, size_t offset, size_t length)
+{
+    types.push_back(type);
+    offsets.push_back(static_cast<uint32_t>(offset));
+    lengths.push_back(static_cast<uint32_t>(length));
+}
+
+void TokenBuffer::reserve(size_t count)
+{
+    types.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+}
+
+// Appends tokens [first, last) of `other`, which must index the same source.
+void TokenBuffer::append(const TokenBuffer& other, size_t first, size_t last)
+{
+    types.insert(types.end(), other.types.begin() + first, other.types.begin() + last);
+    offsets.insert(offsets.end(), other.offsets.begin() + first, other.offsets.begin() + last);
+    lengths.insert(lengths.end(), other.lengths.begin() + first, other.lengths.begin() + last);
+}
+
+void TokenBuffer::finish()
+{
+    lines = SourceMap(source);
+}
+
+void TokenBuffer::finish(SourceMap lines)
+{
+    this->lines = std::move(lines);
+}
+
+std::string_view TokenBuffer::lexeme(size_t i) const
+{
+    // A string literal's lexeme is its contents, without the quotes.
+    if (types[i] == Token::Type::LITERAL) {
+        return source.substr(offsets[i] + 1, lengths[i] - 2);
+    }
+    return text(i);
+}
+
+Token TokenBuffer::token(size_t i) const
+{
+    SourceMap::Position start = lines.position(offsets[i]);
+    SourceMap::Position end = lines.position(offsets[i] + lengths[i]);
+    return Token(types[i], lexeme(i), start.line, start.column, end.line, end.column);
+}
@@ -0,0 +1,92 @@
+#include "typeInference.h"
+#include <charconv>
+
+TypeInference TypeInference::infer(const std::vector<Statement*>& program, const SymbolRegistry& symbols)
+{
+    TypeInference types;
+    for (uint32_t slot = 0; slot < symbols.size(); slot++) {
+        if (symbols.isDefined(slot)) {
+            types.floats.insert(symbols.name(slot));
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const Statement* stmt : program) {
+            changed |= types.demote(stmt);
+        }
+    }
+    return types;
+}
+
+// Marks the variables `stmt` assigns a non-integer; true if any is new.
+bool TypeInference::demote(const Statement* stmt)
+{
+    bool changed = false;
+    if (auto assignment = dynamic_cast<const AssignmentStatement*>(stmt)) {
+        if (!isInteger(assignment->getExpression())) {
+            changed = floats.insert(assignment->getIdentifier().lexeme).second;
+        }
+    } else if (auto ifStmt = dynamic_cast<const IfStatement*>(stmt)) {
+        for (const Statement* inner : ifStmt->getThenBranch()) {
+            changed |= demote(inner);
+        }
+        for (const Statement* inner : ifStmt->getElseBranch()) {
+            changed |= demote(inner);
+        }
+    } else if (auto repeat = dynamic_cast<const RepeatStatement*>(stmt)) {
+        for (const Statement* inner : repeat->getBody()) {
+            changed |= demote(inner);
+        }
+    }
+    return changed;
+}
+
+bool TypeInference::isInteger(const Expr* e) const
+{
+    int64_t value;
+    if (integerConstant(e, value)) {
+        return true;
+    }
+    if (auto variable = dynamic_cast<const VariableExpr*>(e)) {
+        return isInteger(variable->getIdentifier().lexeme);
+    }
+    if (auto grouping = dynamic_cast<const GroupingExpression*>(e)) {
+        return isInteger(grouping->getExpression());
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(e)) {
+        switch (binary->getOperator().type) {
+        case Token::Type::PLUS:
+        case Token::Type::MINUS:
+        case Token::Type::MULTIPLY:
+        case Token::Type::LESS_THAN:
+        case Token::Type::LESS_EQUAL:
+        case Token::Type::GREATER_THAN:
+        case Token::Type::GREATER_EQUAL:
+        case Token::Type::EQUAL:
+        case Token::Type::NOT_EQUAL:
+            return isInteger(binary->getLeft()) && isInteger(binary->getRight());
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+bool TypeInference::integerConstant(const Expr* e, int64_t& value)
+{
+    if (auto constant = dynamic_cast<const ConstantExpr*>(e)) {
+        value = constant->getInteger();
+        return constant->isInteger();
+    }
+    if (auto number = dynamic_cast<const NumberExpr*>(e)) {
+        const Token& token = number->getToken();
+        if (token.type != Token::Type::NUMBER) {
+            return false;
+        }
+        const char* end = token.lexeme.data() + token.lexeme.size();
+        auto result = std::from_chars(token.lexeme.data(), end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+    return false;
+}